@@ -137,6 +137,7 @@ int main(void) {
 #ifndef CDCONLY
 		blaustahl_task();
 #endif
+		fram_write_behind_drain();	// core1's immediate-mode keystrokes
 
 	}
 
@@ -159,6 +160,10 @@ void core1_main(void) {
 
 }
 
+bool cdc_input_pending(void) {
+	return tud_cdc_connected() && tud_cdc_available();
+}
+
 int cdc_getchar(void) {
 	uint8_t buf[1];
 	if (tud_cdc_connected() && tud_cdc_available()) {
@@ -7,21 +7,29 @@
 #ifndef BLAUSTAHL_H_
 #define BLAUSTAHL_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define BLAUSTAHL_VERSION "0.1.0"
 
+// the actual FRAM size is read from the chip at boot (see fram_init()
+// and fram_size()/fram_available() in fram.h) -- this is only the
+// fallback for a part that doesn't answer RDID
 #define FRAM_SIZE 8192		// 8KB
-//#define FRAM_SIZE 262144	// 256KB
 
-#define FRAM_METADATA 512	// reserved for encryption
-#define FRAM_AVAILABLE (FRAM_SIZE - FRAM_METADATA)
+#define FRAM_METADATA 512	// reserved for encryption, at the top of
+							// whatever size was detected
 
-#if FRAM_SIZE >= 262144
- #define FRAM_BIG
-#endif
+// FRAM SPI clock: fram_init() starts at the safe clock, then walks up
+// to the fastest one this unit proves reliable at, never past the
+// datasheet maximum of the part RDID identified (see fram_calibrate()).
+// A part it doesn't recognise stays at the safe clock.
+#define FRAM_CLK_SAFE_HZ	10000000	// 10 MHz
+#define FRAM_CLK_MB85RS64_HZ	20000000	// 20 MHz, MB85RS64 datasheet
+#define FRAM_CLK_MB85RS2MT_HZ	40000000	// 40 MHz, MB85RS2MT datasheet
 
 int cdc_getchar(void);
+bool cdc_input_pending(void);		// a byte is waiting for cdc_getchar()
 void cdc_putchar(const char ch);
 
 void blaustahl_led(uint16_t intensity);
@@ -46,12 +46,12 @@ static int selected = 0;		// logical index into the flash file list
 static int scroll_top = 0;		// logical index of the topmost visible row
 
 // caches the flash-file entries (kind/name/size) for whatever window
-// is currently visible, populated in one batch scan (see
-// refresh_flash_cache()) rather than one directory scan per row --
-// storage_file_at() re-scans the whole directory from the start on
-// every call, which is measurably slow on real flash once there's
-// more than a handful of files and every visible row calls it on
-// every redraw.
+// is currently visible, populated in one batch (see
+// refresh_flash_cache()) rather than one lookup per row. Listing is
+// served from flash_storage.c's in-RAM directory index now, so this
+// mostly saves copying -- but it still matters if the index ever
+// switches itself off (see there) and lookups fall back to
+// re-scanning the directory.
 static file_ref_t flash_cache[BROWSER_LIST_ROWS];
 static int flash_cache_start = -1;
 static int flash_cache_count = 0;
@@ -187,12 +187,8 @@ static int find_current_index(void) {
 
 	file_ref_t target = view_current_file();
 
-	int n = storage_file_count();
-	for (int i = 0; i < n; i++) {
-		file_ref_t f = storage_file_at(i);
-		if (strcmp(f.name, target.name) == 0)
-			return i;
-	}
+	file_ref_t f;
+	if (storage_flash_find(target.name, &f)) return f.index;
 
 	return 0;	// not found (e.g. it was deleted) -- fall back to the top
 
@@ -60,6 +60,7 @@
 #include "vt100.h"
 #include "vt100_input.h"
 #include "storage.h"
+#include "fram.h"
 #include "editor.h"
 #include "xmodem.h"
 #include "view.h"
@@ -199,28 +200,11 @@ static void parse_line(const char *input, char *cmd, char *arg1, char *arg2) {
 
 }
 
-// finds a flash file's full file_ref_t (including size) by name, in
-// batches (same pattern as ls) rather than one storage_file_at() scan
-// per candidate. Returns false if no file with that exact name exists.
+// finds a flash file's full file_ref_t (including size) by name -- a
+// lookup in flash_storage.c's directory index, not a listing walk.
+// Returns false if no file with that exact name exists.
 static bool find_flash_file(const char *name, file_ref_t *out) {
-
-	int n = storage_file_count();
-	file_ref_t batch[STORAGE_BATCH_MAX];
-
-	for (int start = 0; start < n; start += STORAGE_BATCH_MAX) {
-		int want = n - start;
-		if (want > STORAGE_BATCH_MAX) want = STORAGE_BATCH_MAX;
-		int got = storage_flash_file_range(start, want, batch);
-		for (int i = 0; i < got; i++) {
-			if (strcmp(batch[i].name, name) == 0) {
-				*out = batch[i];
-				return true;
-			}
-		}
-	}
-
-	return false;
-
+	return storage_flash_find(name, out);
 }
 
 static bool cli_dispatch(const char *cmd, const char *arg1, const char *arg2) {
@@ -239,6 +223,7 @@ static bool cli_dispatch(const char *cmd, const char *arg1, const char *arg2) {
 		       "  rm <filename>\r\n"
 		       "  firmware_update\r\n"
 		       "  snapshot_fram\r\n"
+		       "  flash_bench <filename>\r\n"
 #ifdef BLAUSTAHL_APPS_ENABLED
 		       "  te <filename>\r\n"
 		       "  load <filename>\r\n"
@@ -285,17 +270,47 @@ static bool cli_dispatch(const char *cmd, const char *arg1, const char *arg2) {
 			default:               fram_status = "UNKNOWN";            break;
 		}
 
+		// the chip and clock lines show what fram_init() actually
+		// detected and calibrated: the RDID bytes when the part
+		// identified itself (or a note that the compile-time default
+		// is in use when it didn't), and the SPI clock and read opcode
+		// the boot-time calibration settled on
+		uint8_t id[4];
+		fram_get_id(id);
+		char chip[48];
+		if (fram_valid_id())
+			snprintf(chip, sizeof(chip), "%u BYTES, ID %02X %02X %02X %02X",
+				fram_size(), id[0], id[1], id[2], id[3]);
+		else
+			snprintf(chip, sizeof(chip), "%u BYTES (NO ID, ASSUMED)",
+				fram_size());
+
+		flash_stats_t fst;
+		flash_storage_stats(&fst);
+
 		printf("FIRMWARE: %s\r\n"
 		       "BOARD ID: %s\r\n"
-		       "FRAM: %i BYTES (%s)\r\n"
-		       "SRAM: %i BYTES\r\n"
-		       "FLASH: %i FILES, %u/%u KB FREE\r\n",
+		       "FRAM: %u BYTES (%s)\r\n"
+		       "FRAM CHIP: %s\r\n"
+		       "FRAM CLOCK: %u.%u MHZ, %s%s\r\n"
+		       "SRAM: %u BYTES\r\n"
+		       "FLASH: %i FILES, %u/%u KB FREE\r\n"
+		       "FLASH WRITES: %u PAGES + %u ERASES IN %u LOCKOUTS, "
+		       "%u ERASES SKIPPED (PRE-ERASED WHILE IDLE: %u)\r\n"
+		       "FLASH READ CACHE: %u HITS, %u MISSES\r\n",
 			BLAUSTAHL_VERSION,
 			board_id,
-			FRAM_AVAILABLE, fram_status,
-			FRAM_AVAILABLE,
+			fram_available(), fram_status,
+			chip,
+			fram_clock_hz() / 1000000, (fram_clock_hz() / 100000) % 10,
+			fram_fast_read() ? "FAST READ" : "READ",
+			fram_mirrored() ? ", RAM MIRROR" : "",
+			storage_sram_ref().size,
 			storage_file_count(),
-			storage_flash_free() / 1024, storage_flash_total() / 1024);
+			storage_flash_free() / 1024, storage_flash_total() / 1024,
+			fst.progs, fst.erases, fst.lockouts,
+			fst.erases_skipped, fst.idle_erases,
+			fst.cache_hits, fst.cache_misses);
 
 #ifdef BLAUSTAHL_APPS_ENABLED
 		uint32_t sys_total = ms_glue_system_heap_total();
@@ -374,17 +389,11 @@ static bool cli_dispatch(const char *cmd, const char *arg1, const char *arg2) {
 		switch (r) {
 			case XMODEM_OK:           printf("RECEIVED OK.");                          break;
 			case XMODEM_CANCELLED:    printf("CANCELLED BY SENDER.");                  break;
-			case XMODEM_TOO_LARGE:    printf("FILE TOO LARGE FOR STAGING BUFFER.");    break;
+			case XMODEM_TOO_LARGE:    printf("NOT ENOUGH FREE FLASH FOR THIS FILE.");  break;
 			case XMODEM_WRITE_FAILED: printf("RECEIVED OK, BUT FAILED TO WRITE FLASH."); break;
+			case XMODEM_OPEN_FAILED:  printf("COULDN'T OPEN '%s' FOR WRITING (FLASH BUSY?) -- NOTHING RECEIVED.", arg1); break;
+			case XMODEM_WRITE_ABORTED: printf("FLASH WRITE FAILED -- TRANSFER ABORTED."); break;
 			case XMODEM_TIMEOUT:      printf("TIMED OUT WAITING FOR SENDER.");         break;
-			case XMODEM_OUT_OF_MEMORY:
-#ifdef BLAUSTAHL_APPS_ENABLED
-				printf("NOT ENOUGH FREE MEMORY RIGHT NOW -- "
-					"TRY AGAIN, OR RUN 'clear' TO FREE UP THE SCHEME HEAP.");
-#else
-				printf("NOT ENOUGH FREE MEMORY RIGHT NOW -- TRY AGAIN.");
-#endif
-				break;
 			case XMODEM_NOT_FOUND:    break;	// send-only result, unreachable here
 		}
 		return true;
@@ -433,9 +442,8 @@ static bool cli_dispatch(const char *cmd, const char *arg1, const char *arg2) {
 			case XMODEM_NOT_FOUND:    printf("FILE NOT FOUND: '%s'", arg1);  break;
 			case XMODEM_TOO_LARGE:    break;	// receive-only result, unreachable here
 			case XMODEM_WRITE_FAILED: break;	// receive-only result, unreachable here
-			case XMODEM_OUT_OF_MEMORY: break;	// receive-only result, unreachable here
-										// (send streams through a fixed
-										// 128-byte buffer, nothing to allocate)
+			case XMODEM_OPEN_FAILED:  break;	// receive-only result, unreachable here
+			case XMODEM_WRITE_ABORTED: break;	// receive-only result, unreachable here
 		}
 		return true;
 
@@ -511,6 +519,34 @@ static bool cli_dispatch(const char *cmd, const char *arg1, const char *arg2) {
 		return true;
 	}
 
+	if (strcmp(cmd, "flash_bench") == 0) {
+
+		if (!arg1[0]) {
+			printf("USAGE: flash_bench <filename>");
+			return true;
+		}
+
+		flash_bench_t b;
+		if (!flash_storage_bench(arg1, &b)) {
+			printf("FILE NOT FOUND OR READ FAILED: '%s'", arg1);
+			return true;
+		}
+
+		// KB/s with the time rounded up to a whole millisecond, so a
+		// tiny file doesn't divide by zero
+		for (int pass = 0; pass < 2; pass++) {
+			uint32_t ms = (b.us[pass] + 999) / 1000;
+			if (ms == 0) ms = 1;
+			printf("%s: %u BYTES IN %u US (%u KB/S), %u XIP CACHE MISSES\r\n",
+				pass ? "STREAMED" : "CACHED  ",
+				b.bytes, b.us[pass], b.bytes / ms * 1000 / 1024,
+				b.xip_misses[pass]);
+		}
+		if (!b.streamed) printf("(NO DMA CHANNEL -- BOTH PASSES WERE CACHED)");
+		return true;
+
+	}
+
 	if (strcmp(cmd, "view") == 0) {
 
 		if (!arg1[0]) {
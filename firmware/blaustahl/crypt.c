@@ -48,6 +48,39 @@ int crypt_hash(const uint8_t *data, size_t len, uint8_t *out32) {
 
 }
 
+int crypt_hash_start(crypt_hash_ctx_t *ctx) {
+
+	// psa_crypto_init() is idempotent, and unlike crypt_hash()'s
+	// callers, srwp.c may get here before anything else has run it
+	if (psa_crypto_init() != PSA_SUCCESS) return 0;
+
+	*ctx = (crypt_hash_ctx_t)PSA_HASH_OPERATION_INIT;
+	if (psa_hash_setup(ctx, PSA_ALG_SHA_256) == PSA_SUCCESS) return 1;
+
+	psa_hash_abort(ctx);
+	return 0;
+
+}
+
+int crypt_hash_update(crypt_hash_ctx_t *ctx, const uint8_t *data, size_t len) {
+
+	if (psa_hash_update(ctx, data, len) == PSA_SUCCESS) return 1;
+
+	psa_hash_abort(ctx);
+	return 0;
+
+}
+
+int crypt_hash_finish(crypt_hash_ctx_t *ctx, uint8_t *out32) {
+
+	size_t out_len = 0;
+	psa_status_t status = psa_hash_finish(ctx, out32, 32, &out_len);
+	if (status != PSA_SUCCESS) psa_hash_abort(ctx);
+
+	return (status == PSA_SUCCESS && out_len == 32) ? 1 : 0;
+
+}
+
 int crypt_kdf(const char *password, const uint8_t *salt, uint8_t *key_out) {
 
 	uint8_t pass_salt[32 + 16];
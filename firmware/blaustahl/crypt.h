@@ -28,6 +28,16 @@ int crypt_init(psa_key_id_t *key, const uint8_t *key_bytes);
 // turns out to provide.
 int crypt_hash(const uint8_t *data, size_t len, uint8_t *out32);
 
+// the same SHA-256, fed a piece at a time -- for data that's never in
+// RAM all at once (srwp.c hashes FRAM ranges through a small chunk
+// buffer). start, any number of updates, then finish, which writes
+// the same digest crypt_hash() would have for all of it together.
+// Any failure leaves ctx finished; nothing needs cleaning up.
+typedef psa_hash_operation_t crypt_hash_ctx_t;
+int crypt_hash_start(crypt_hash_ctx_t *ctx);
+int crypt_hash_update(crypt_hash_ctx_t *ctx, const uint8_t *data, size_t len);
+int crypt_hash_finish(crypt_hash_ctx_t *ctx, uint8_t *out32);
+
 // derives a 32-byte key from SHA256(password || salt). password is
 // treated as a C string, up to 32 characters, zero-padded to exactly
 // 32 bytes before hashing (so "hi" and "hi" followed by 30 NUL bytes
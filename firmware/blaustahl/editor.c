@@ -9,10 +9,12 @@
  * is the source of truth; each renderer projects it into its own
  * row/column layout, which is what lets TEXT<->HEX preserve position.
  *
- * Writing only ever happens through storage_write(), which itself only
- * ever succeeds for FRAM (storage_can_write()) -- flash is view-only.
- * That's enforced at the storage layer, not just here, so a UI mistake
- * here can't turn into a write against flash.
+ * Writing only ever happens through storage_write(). For FRAM and SRAM
+ * that may go straight to the backend; for a flash file (opened here
+ * from the viewer, see editor_edit_file()) it only ever lands in
+ * buffer mode's RAM pages, which a commit writes back in place. That's
+ * enforced at the storage layer, not just here, so a UI mistake here
+ * can't turn into a byte-at-a-time write against flash.
  */
 
 #include <stdio.h>
@@ -20,6 +22,8 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "pico/time.h"
+
 #include "blaustahl.h"
 #include "editor.h"
 #include "srwp.h"
@@ -30,6 +34,7 @@
 #include "storage.h"
 #include "cli.h"
 #include "view.h"
+#include "fram_dma.h"
 
 #define ROWS 24
 #define TEXT_COLS 80
@@ -63,16 +68,17 @@ const char help_editor[] =
 	"\r\n"
 	"CTRL-C / CTRL-V  COPY / PASTE -- SHARED BY GRID EDITOR AND VIEWER\r\n"
 	"\r\n"
-	"GRID EDITOR (FRAM/SRAM, 7680 BYTES, 4 PAGES):\r\n"
+	"GRID EDITOR (FRAM/SRAM, FIXED SIZE -- SEE FRAM SIZE ABOVE):\r\n"
 	"  PGUP/PGDN      FLIP PAGE\r\n"
 	"  CTRL-B         TOGGLE BUFFER MODE\r\n"
 	"  CTRL-W         TOGGLE WRITE MODE / COMMIT BUFFER\r\n"
 	"  CTRL-S/Q       TOGGLE STATUS BAR\r\n"
 	"\r\n"
-	"VIEWER (FLASH FILES, ANY SIZE -- READ-ONLY):\r\n"
+	"VIEWER (FLASH FILES, ANY SIZE):\r\n"
 	"  UP/DOWN        SCROLL ONE LINE\r\n"
 	"  PGUP/PGDN      SCROLL ONE SCREEN\r\n"
 	"  HOME           JUMP TO START\r\n"
+	"  CTRL-E         EDIT IN HEX (BUFFERED -- CTRL-W COMMITS IN PLACE)\r\n"
 	"\r\n"
 	"FRAM SHOWS LOCKED IF ENCRYPTED -- UNLOCK: CTRL-T -> CLI -> password\r\n";
 
@@ -118,11 +124,16 @@ static bool boot_hint_shown = false;
 // FRAM write), shown once on the next status render, then cleared --
 // same "arm once, show once" shape as the boot hint above.
 static bool srwp_write_warning_pending = false;
+static bool srwp_flash_warning_pending = false;
 
 void editor_notify_srwp_write(void) {
 	srwp_write_warning_pending = true;
 }
 
+void editor_notify_srwp_flash_write(void) {
+	srwp_flash_warning_pending = true;
+}
+
 // CTRL-C toggles copy mode: first press marks the current cursor
 // position as the selection's origin; cursor movement from there
 // extends the highlighted range; a second CTRL-C copies that range
@@ -279,13 +290,13 @@ static void draw_text_page(void) {
 
 	// deliberately draws all ROWS (24) rows unconditionally, even
 	// though the status line will cover row 24 when status_enabled --
-	// page_size() is ROWS*bytes_per_row() (FRAM_AVAILABLE is exactly
-	// 4 such pages, 80*24*4, by design), so every byte in a page must
-	// actually get drawn somewhere or it becomes permanently
-	// unreachable, not just visually deferred. editor_status() always
-	// runs after this and overwrites row 24 with the status line when
-	// enabled -- that's what makes the status line appear, not
-	// skipping row 24's content here.
+	// page_size() is ROWS*bytes_per_row() (an 8KB part's available
+	// region is exactly 4 such pages, 80*24*4, by design), so every
+	// byte in a page must actually get drawn somewhere or it becomes
+	// permanently unreachable, not just visually deferred.
+	// editor_status() always runs after this and overwrites row 24
+	// with the status line when enabled -- that's what makes the
+	// status line appear, not skipping row 24's content here.
 	//
 	// Exact fixed-grid rendering: this editor is strictly for
 	// FRAM/SRAM (fixed-size, exact byte-addressable) -- flash files
@@ -386,10 +397,15 @@ void editor_status(void) {
 		edit_state = "SRWP WROTE FRAM";
 		srwp_write_warning_pending = false;
 	}
+	else if (srwp_flash_warning_pending) {
+		edit_state = "SRWP WROTE FLASH";
+		srwp_flash_warning_pending = false;
+	}
 	else if (current_file.kind == STORAGE_FRAM &&
 			storage_crypt_status() == CRYPT_LOCKED)
 		edit_state = "LOCKED";
 	else if (!storage_can_write(current_file)) edit_state = "VIEW";
+	else if (storage_buffer_full()) edit_state = "BUFFER FULL, COMMIT";
 	else if (storage_buffer_active())
 		edit_state = storage_buffer_dirty() ? "BUFFER*" : "BUFFER";
 	else if (write_enabled) edit_state = "EDIT";
@@ -463,15 +479,26 @@ void editor_return_to_grid(void) {
 	editor_redraw();
 }
 
-// strictly for FRAM/SRAM now -- flash files are viewed with view.c
-// instead (see browser.c), so current_file.kind is always FRAM or
-// SRAM whenever this is called.
+// flash files are opened with view.c instead (see browser.c), and
+// only get here through editor_edit_file() below
 void editor_open_current_file(void) {
 	cursor_offset = 0;
 	mode = MODE_GRID;
 	editor_redraw();
 }
 
+bool editor_edit_file(file_ref_t f, long offset) {
+
+	if (!storage_select(f)) return false;
+
+	render_mode = 1;
+	cursor_offset = (offset >= 0 && offset < (long)f.size) ? offset : 0;
+	mode = MODE_GRID;
+	editor_redraw();
+	return true;
+
+}
+
 static int mode_before_help = MODE_GRID;
 
 void editor_help(void) {
@@ -488,7 +515,7 @@ void editor_help(void) {
 	printf(blaustahl_banner, BLAUSTAHL_VERSION, "COMPOSITE");
 #endif
 
-	printf("FRAM size: %i bytes\r\n", FRAM_AVAILABLE);
+	printf("FRAM size: %u bytes\r\n", storage_fram_ref().size);
 
 	printf(help_editor);
 	printf(help_press_any_key);
@@ -547,10 +574,33 @@ static void handle_key_files(void) {
 	browser_init();
 }
 
+// Flash maintenance (mapping used blocks, erasing free ones ahead of
+// the next write) runs here once there's been no input for
+// IDLE_AFTER_MS, one short step per pass, and each step stops as soon
+// as cdc_input_pending() -- so the next keypress is picked up after
+// at most one block's worth of work, and typing in bursts never
+// triggers it at all.
+// srwp_idle() is cheap and has its own timeout, so it runs every pass.
+#define IDLE_AFTER_MS 500
+
+static uint32_t last_input_ms = 0;
+
+static void editor_idle(void) {
+	srwp_idle();
+	if (to_ms_since_boot(get_absolute_time()) - last_input_ms < IDLE_AFTER_MS)
+		return;
+	storage_idle(cdc_input_pending);
+}
+
 void editor_yield(void) {
 
 	blaustahl_led(led);
 
+	// retire/advance any asynchronous FRAM transfer still queued --
+	// first thing, before any of the early returns below, so it keeps
+	// moving while the editor is otherwise just idling
+	fram_dma_poll();
+
 	int redraw = 0;
 
 	// must run before attempting to read a byte -- a lone ESC with
@@ -563,7 +613,11 @@ void editor_yield(void) {
 	}
 
 	int c = cdc_getchar();
-	if (c == EOF) return;
+	if (c == EOF) {
+		editor_idle();
+		return;
+	}
+	last_input_ms = to_ms_since_boot(get_absolute_time());
 
 	if (c == 0) {
 		srwp();
@@ -687,8 +741,8 @@ void editor_yield(void) {
 				return;
 			}
 
-			for (uint32_t i = 0; i < copy_buffer_len; i++)
-				storage_write(current_file, cursor_offset + i, (char)copy_buffer[i]);
+			storage_write_range(current_file, (uint32_t)cursor_offset,
+				(const char *)copy_buffer, copy_buffer_len);
 
 			cursor_offset += (long)copy_buffer_len - 1;
 
@@ -777,7 +831,13 @@ void editor_yield(void) {
 				}
 			} else if (cc == CH_ETB) {
 				if (storage_buffer_active()) {
-					storage_buffer_commit();
+					if (!storage_buffer_commit()) {
+						printf(VT100_CURSOR_MOVE_TO, ROWS, 1);
+						printf(VT100_ERASE_LINE);
+						printf("BLAUSTAHL -- COMMIT FAILED");
+						fflush(stdout);
+						return;
+					}
 				} else {
 					write_enabled = !write_enabled;
 				}
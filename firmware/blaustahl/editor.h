@@ -2,10 +2,14 @@
 #define EDITOR_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "storage.h"
 
 // application modes -- shared with menu.c/browser.c
 
-#define MODE_GRID  1	// viewer/editor for current_file (TEXT or HEX render) -- FRAM/SRAM only
+#define MODE_GRID  1	// viewer/editor for current_file (TEXT or HEX render) -- FRAM/SRAM,
+						// or a flash file opened for editing from the viewer
 #define MODE_HELP  2
 #define MODE_MENU  3	// top menu bar overlay
 #define MODE_FILES 4	// file browser
@@ -40,6 +44,12 @@ void editor_return_to_grid(void);
 // chosen -- that's a standing preference, not a per-file property.
 void editor_open_current_file(void);
 
+// selects f and opens it in MODE_GRID's HEX render, cursor at offset --
+// how the viewer hands a flash file over for editing (buffered, and
+// committed in place: see storage.c). False, with nothing changed, if
+// storage_select() refuses.
+bool editor_edit_file(file_ref_t f, long offset);
+
 // shared copy buffer, used by both the grid editor and cat.c so
 // copying in one and pasting in the other works on the same
 // underlying storage rather than two independent buffers.
@@ -67,4 +77,9 @@ int editor_mode_before_help(void);
 // "show once, then clear" pattern as the first-boot hint.
 void editor_notify_srwp_write(void);
 
+// the same, after SRWP has created, replaced, renamed or deleted a
+// flash file: a flash file open in the editor may no longer match
+// what's on flash, and committing it would undo SRWP's change
+void editor_notify_srwp_flash_write(void);
+
 #endif
@@ -42,9 +42,15 @@
 
 #include <string.h>
 
+#include <stdlib.h>
+
 #include "pico/flash.h"
+#include "pico/time.h"
 #include "hardware/flash.h"
+#include "hardware/dma.h"
 #include "hardware/regs/addressmap.h"
+#include "hardware/regs/dreq.h"
+#include "hardware/structs/xip_ctrl.h"
 
 #include "lfs.h"
 #include "flash_storage.h"
@@ -65,52 +71,295 @@ _Static_assert(FLASH_TARGET_OFFSET + (FS_BLOCK_COUNT * FS_BLOCK_SIZE)
 
 #define FLASH_SAFE_TIMEOUT_MS 1000
 
+// ---- write batching ----
+//
+// Every flash_safe_execute() is a full lockout: core0 (and with it USB)
+// is parked, interrupts are off, and the XIP cache is flushed
+// afterwards. littlefs programs a page (256 bytes) at a time, so doing
+// that per call meant one lockout per page -- 16 of them plus an erase
+// for every 4KB of file written.
+//
+// Instead, programs and erases are collected here and carried out
+// together in one lockout: a run of programs to consecutive addresses,
+// optionally preceded by the erase of the block they start in (the
+// usual shape: littlefs erases a block, then fills it). Anything that
+// doesn't extend the current batch flushes it first and starts a new
+// one; so does sync (littlefs syncs at the end of every commit and file
+// sync, so nothing it considers durable is ever still sitting here), a
+// full buffer, and a read of anything the batch is about to change.
+//
+// FLASH_BATCH_SIZE is a CMake cache variable: the most program data one
+// lockout carries. The default, one block, bounds a lockout at one
+// erase plus 16 page programs -- ~50ms, well inside
+// FLASH_SAFE_TIMEOUT_MS.
+#ifndef FLASH_BATCH_SIZE
+#define FLASH_BATCH_SIZE FS_BLOCK_SIZE
+#endif
+_Static_assert(FLASH_BATCH_SIZE >= FS_PROG_SIZE &&
+	FLASH_BATCH_SIZE % FS_PROG_SIZE == 0,
+	"FLASH_BATCH_SIZE must be a whole number of pages");
+#define NO_ERASE 0xffffffffu
+
+static struct {
+	uint32_t erase_addr;		// block to erase first, or NO_ERASE
+	uint32_t prog_addr;			// start of the program run
+	uint32_t prog_len;			// 0 if there's none
+	uint8_t data[FLASH_BATCH_SIZE];
+} batch = { .erase_addr = NO_ERASE };
+
+static flash_stats_t stats;
+
+// set by any program or erase littlefs does, so idle maintenance (see
+// flash_storage_idle()) knows its picture of free blocks is stale --
+// except while that maintenance is itself the one calling littlefs
+static bool idle_stale = true;
+static bool idle_active = false;
+
+// blocks idle maintenance has itself erased since boot, and nothing has
+// programmed since -- the only ones rp2040_erase() may skip. A bit is
+// set only once the erase has run to completion, and cleared by the
+// first program into the block.
+static uint32_t pre_erased[(FS_BLOCK_COUNT + 31) / 32];
+
+// erased NOR reads back all ones, so a free block that doesn't can't
+// be erased yet -- but the converse doesn't hold: a block whose erase
+// was cut short by a power loss can read all ones with its cells only
+// partly erased, and programs into it may not hold. Reading blank is
+// only good enough to leave a block alone; see pre_erased for when an
+// erase can actually be skipped.
+static bool block_blank(uint32_t addr) {
+	const uint32_t *p = (const uint32_t *)(XIP_BASE + addr);
+	for (uint32_t i = 0; i < FS_BLOCK_SIZE / 4; i++)
+		if (p[i] != 0xffffffffu) return false;
+	return true;
+}
+
+// ---- read cache ----
+//
+// littlefs itself caches one read_size (256-byte) page at a time, so
+// walking a directory or a file's skip-list re-reads the same metadata
+// pages from XIP over and over -- XIP's own cache is 16KB shared with
+// every instruction both cores execute, so those pages rarely stay in
+// it. This keeps the last FLASH_READ_CACHE_LINES pages littlefs read
+// (a CMake cache variable, 256 bytes each), least recently used
+// replaced first.
+//
+// Only page-sized reads go through it -- that's every read littlefs
+// makes through its own caches, metadata included. Anything bigger is
+// bulk file data littlefs is reading straight into a caller's buffer,
+// which would only push the metadata out, so it goes straight to XIP.
+//
+// Every program or erase invalidates what it touches at the moment
+// it's queued (see write batching below), so a cached page is never
+// older than flash -- or than what flash is about to hold.
+#ifndef FLASH_READ_CACHE_LINES
+#define FLASH_READ_CACHE_LINES 16
+#endif
+#define NO_LINE 0xffffffffu
+
+static struct {
+	uint32_t addr;			// flash offset of the page, or NO_LINE
+	uint32_t last_use;
+	uint8_t data[FS_PROG_SIZE];
+} rcache[FLASH_READ_CACHE_LINES];
+
+static uint32_t rcache_clock = 0;
+static bool rcache_ready = false;
+
+static void rcache_invalidate(uint32_t addr, uint32_t len) {
+	for (int i = 0; i < FLASH_READ_CACHE_LINES; i++)
+		if (rcache[i].addr != NO_LINE &&
+				rcache[i].addr < addr + len && addr < rcache[i].addr + FS_PROG_SIZE)
+			rcache[i].addr = NO_LINE;
+}
+
+// serves a read that lies within one page, from cache or into it
+static void rcache_read(uint32_t addr, void *buffer, uint32_t size) {
+
+	if (!rcache_ready) {
+		for (int i = 0; i < FLASH_READ_CACHE_LINES; i++) rcache[i].addr = NO_LINE;
+		rcache_ready = true;
+	}
+
+	uint32_t line = addr & ~(uint32_t)(FS_PROG_SIZE - 1);
+	int victim = 0;
+
+	for (int i = 0; i < FLASH_READ_CACHE_LINES; i++) {
+		if (rcache[i].addr == line) {
+			rcache[i].last_use = ++rcache_clock;
+			stats.cache_hits++;
+			memcpy(buffer, &rcache[i].data[addr - line], size);
+			return;
+		}
+		if (rcache[victim].addr == NO_LINE) continue;
+		if (rcache[i].addr == NO_LINE || rcache[i].last_use < rcache[victim].last_use)
+			victim = i;
+	}
+
+	stats.cache_misses++;
+	memcpy(rcache[victim].data, (const void *)(XIP_BASE + line), FS_PROG_SIZE);
+	rcache[victim].addr = line;
+	rcache[victim].last_use = ++rcache_clock;
+	memcpy(buffer, &rcache[victim].data[addr - line], size);
+
+}
+
+// ---- bulk reads ----
+//
+// A large read -- file data littlefs reads straight into a caller's
+// buffer: XMODEM send, the viewer, te loading a file -- copied through
+// XIP's normal mapping goes through its 16KB cache, which is also where
+// both cores' instructions live; reading a big file evicts the
+// firmware's own hot code, which then stalls on refetching it. So reads
+// of FLASH_STREAM_MIN bytes or more use the XIP streaming FIFO instead,
+// emptied by DMA: it reads flash without allocating in the cache at
+// all. Smaller reads -- metadata, mostly -- stay on the cached path
+// (and the read cache above), where repeated hits are the point.
+//
+// Falls back to memcpy() if no DMA channel could be had, or the
+// destination isn't word-aligned (the FIFO is 32 bits wide).
+// flash_storage_bench() compares the two on a real file.
+#ifndef FLASH_STREAM_MIN
+#define FLASH_STREAM_MIN 1024
+#endif
+
+static int stream_dma = -1;
+static bool stream_enabled = true;
+
+static void xip_stream_read(uint32_t addr, uint8_t *dst, uint32_t size) {
+
+	uint32_t words = size / 4;
+
+	// anything left over from an earlier stream would come out first
+	while (!(xip_ctrl_hw->stat & XIP_STAT_FIFO_EMPTY))
+		(void)xip_ctrl_hw->stream_fifo;
+
+	xip_ctrl_hw->stream_addr = XIP_BASE + addr;
+	xip_ctrl_hw->stream_ctr = words;
+
+	dma_channel_config c = dma_channel_get_default_config(stream_dma);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, false);
+	channel_config_set_write_increment(&c, true);
+	channel_config_set_dreq(&c, DREQ_XIP_STREAM);
+	dma_channel_configure(stream_dma, &c, dst,
+		(const void *)XIP_AUX_BASE, words, true);
+	dma_channel_wait_for_finish_blocking(stream_dma);
+
+	if (size % 4)
+		memcpy(dst + words * 4, (const void *)(XIP_BASE + addr + words * 4),
+			size % 4);
+
+}
+
+static void batch_op(void *param) {
+	(void)param;
+	if (batch.erase_addr != NO_ERASE)
+		flash_range_erase(batch.erase_addr, FS_BLOCK_SIZE);
+	if (batch.prog_len)
+		flash_range_program(batch.prog_addr, batch.data, batch.prog_len);
+}
+
+static int batch_flush(void) {
+
+	if (batch.erase_addr == NO_ERASE && batch.prog_len == 0) return 0;
+
+	int rc = flash_safe_execute(batch_op, NULL, FLASH_SAFE_TIMEOUT_MS);
+	stats.lockouts++;
+
+	batch.erase_addr = NO_ERASE;
+	batch.prog_len = 0;
+
+	return (rc == PICO_OK) ? 0 : LFS_ERR_IO;
+
+}
+
 static int rp2040_read(const struct lfs_config *c, lfs_block_t block,
 		lfs_off_t off, void *buffer, lfs_size_t size) {
 	(void)c;
-	uint32_t addr = XIP_BASE + FLASH_TARGET_OFFSET + block * FS_BLOCK_SIZE + off;
-	memcpy(buffer, (const void *)addr, size);
-	return 0;
-}
 
-struct prog_params {
-	uint32_t addr;
-	const uint8_t *data;
-	size_t size;
-};
+	// flash doesn't hold what's still in the batch yet
+	uint32_t start = FLASH_TARGET_OFFSET + block * FS_BLOCK_SIZE + off;
+	bool pending =
+		(batch.erase_addr == start - off) ||
+		(batch.prog_len && start < batch.prog_addr + batch.prog_len &&
+			batch.prog_addr < start + size);
+	if (pending) {
+		int err = batch_flush();
+		if (err) return err;
+	}
 
-static void prog_op(void *param) {
-	struct prog_params *p = (struct prog_params *)param;
-	flash_range_program(p->addr, p->data, p->size);
+	if ((start & (FS_PROG_SIZE - 1)) + size <= FS_PROG_SIZE)
+		rcache_read(start, buffer, size);
+	else if (stream_enabled && stream_dma >= 0 && size >= FLASH_STREAM_MIN &&
+			((uintptr_t)buffer & 3) == 0 && (start & 3) == 0)
+		xip_stream_read(start, buffer, size);
+	else
+		memcpy(buffer, (const void *)(XIP_BASE + start), size);
+	return 0;
 }
 
 static int rp2040_prog(const struct lfs_config *c, lfs_block_t block,
 		lfs_off_t off, const void *buffer, lfs_size_t size) {
 	(void)c;
-	struct prog_params p = {
-		.addr = FLASH_TARGET_OFFSET + block * FS_BLOCK_SIZE + off,
-		.data = buffer,
-		.size = size,
-	};
-	int rc = flash_safe_execute(prog_op, &p, FLASH_SAFE_TIMEOUT_MS);
-	return (rc == PICO_OK) ? 0 : LFS_ERR_IO;
-}
 
-static void erase_op(void *param) {
-	uint32_t addr = *(uint32_t *)param;
-	flash_range_erase(addr, FS_BLOCK_SIZE);
+	uint32_t addr = FLASH_TARGET_OFFSET + block * FS_BLOCK_SIZE + off;
+	stats.progs++;
+	if (block < FS_BLOCK_COUNT) pre_erased[block / 32] &= ~(1u << (block % 32));
+	if (!idle_active) idle_stale = true;
+	rcache_invalidate(addr, size);
+
+	bool extends = batch.prog_len
+		? (addr == batch.prog_addr + batch.prog_len)
+		: (batch.erase_addr == NO_ERASE ||
+			batch.erase_addr == addr - off);
+
+	if (!extends || batch.prog_len + size > FLASH_BATCH_SIZE) {
+		int err = batch_flush();
+		if (err) return err;
+	}
+
+	if (batch.prog_len == 0) batch.prog_addr = addr;
+	memcpy(&batch.data[batch.prog_len], buffer, size);
+	batch.prog_len += size;
+
+	return 0;
 }
 
 static int rp2040_erase(const struct lfs_config *c, lfs_block_t block) {
 	(void)c;
+
+	stats.erases++;
+	if (!idle_active) idle_stale = true;
+
+	// an erase only ever starts a batch
+	int err = batch_flush();
+	if (err) return err;
+
+	rcache_invalidate(FLASH_TARGET_OFFSET + block * FS_BLOCK_SIZE, FS_BLOCK_SIZE);
+
+	// idle maintenance erased it ahead of time, so the programs that
+	// follow can go straight in. The blank check is belt and braces --
+	// on its own it proves nothing (see block_blank())
 	uint32_t addr = FLASH_TARGET_OFFSET + block * FS_BLOCK_SIZE;
-	int rc = flash_safe_execute(erase_op, &addr, FLASH_SAFE_TIMEOUT_MS);
-	return (rc == PICO_OK) ? 0 : LFS_ERR_IO;
+	if (block < FS_BLOCK_COUNT &&
+			(pre_erased[block / 32] & (1u << (block % 32))) &&
+			block_blank(addr)) {
+		stats.erases_skipped++;
+		return 0;
+	}
+
+	batch.erase_addr = addr;
+	return 0;
 }
 
 static int rp2040_sync(const struct lfs_config *c) {
 	(void)c;
-	return 0;
+	return batch_flush();
+}
+
+void flash_storage_stats(flash_stats_t *out) {
+	*out = stats;
 }
 
 static uint8_t read_buf[FS_PROG_SIZE];
@@ -147,8 +396,418 @@ static const struct lfs_config flash_cfg = {
 static lfs_t lfs;
 static bool mounted = false;
 
+// ---- used-space accounting ----
+//
+// lfs_fs_size() -- the only way littlefs offers to find out how full it
+// is -- traverses the whole filesystem, and the browser's status bar
+// wants the free space on every redraw. So the used-block count is kept
+// here instead: counted exactly by one traversal at mount (and format),
+// then adjusted by every write, delete and rename-over, by the number
+// of blocks the file that came or went occupies. That's an estimate
+// (it doesn't see metadata blocks come and go, and littlefs's exact
+// CTZ overhead varies), so it's re-verified by a real traversal the
+// next time the UI is idle after any change (see flash_storage_idle(),
+// which needs the same map anyway). flash_storage_free() itself never
+// traverses unless the count was lost to a failed traversal.
+//
+// used_map ends up holding the blocks in use, one bit each, as a side
+// effect -- the idle task's erase-ahead works from it.
+static uint32_t used_map[(FS_BLOCK_COUNT + 31) / 32];
+static int32_t used_blocks = -1;		// -1: not known
+
+// littlefs keeps a file this small inline in its directory's metadata,
+// using no blocks of its own (its default inline limit is the cache
+// size, with this configuration)
+#define FS_INLINE_MAX FS_PROG_SIZE
+
+// used_stop is the traversal's stop check, if it has one: asked once
+// per block, and a true answer ends the traversal then and there (the
+// 1 lfs_fs_traverse() hands back, told apart from its own errors)
+#define USED_STOPPED 1
+
+static bool (*used_stop)(void) = NULL;
+
+static int used_mark(void *ctx, lfs_block_t block) {
+	(void)ctx;
+	if (used_stop && used_stop()) return USED_STOPPED;
+	if (block < FS_BLOCK_COUNT) used_map[block / 32] |= 1u << (block % 32);
+	return 0;
+}
+
+// exact count, by a full traversal: 0 once done, a littlefs error if
+// it failed, or USED_STOPPED if stop (which may be NULL) cut it short
+// -- the count is then left as it was, since nothing about it has
+// been learned either way.
+static int used_recount(bool (*stop)(void)) {
+
+	memset(used_map, 0, sizeof(used_map));
+	used_stop = stop;
+	int err = lfs_fs_traverse(&lfs, used_mark, NULL);
+	used_stop = NULL;
+	if (err == USED_STOPPED) return err;
+	if (err) {
+		used_blocks = -1;
+		return err;
+	}
+
+	int32_t n = 0;
+	for (uint32_t i = 0; i < sizeof(used_map) / sizeof(used_map[0]); i++)
+		n += __builtin_popcount(used_map[i]);
+	used_blocks = n;
+	return 0;
+
+}
+
+// blocks a file of this size occupies: none if inline, otherwise its
+// CTZ skip-list, whose pointers take a word or two out of each block
+static int32_t file_blocks(uint32_t size) {
+	if (size <= FS_INLINE_MAX) return 0;
+	return (int32_t)((size + FS_BLOCK_SIZE - 9) / (FS_BLOCK_SIZE - 8));
+}
+
+// the estimate's adjustment -- a file of old_size (if had_old) replaced
+// by one of new_size (0 for a delete)
+static void used_adjust(bool had_old, uint32_t old_size, uint32_t new_size) {
+	if (used_blocks < 0) return;
+	used_blocks += file_blocks(new_size) - (had_old ? file_blocks(old_size) : 0);
+	if (used_blocks < 0) used_blocks = 0;
+	if (used_blocks > FS_BLOCK_COUNT) used_blocks = FS_BLOCK_COUNT;
+}
+
+// ---- directory index ----
+//
+// Every regular file in the root, name and size, kept sorted by name in
+// RAM -- the same order lfs_dir_read() returns them in, since littlefs
+// keeps its directory entries sorted. Built once by a single scan at
+// mount, then kept current by every call in this file that changes
+// the directory (write, rename, delete, format), so listing, counting,
+// indexing and name lookups never touch flash: count and index are
+// O(1), a name lookup is a binary search. The browser calls these on
+// every redraw and every cursor move.
+//
+// Bounded at FLASH_DIR_INDEX_MAX entries (a CMake cache variable) of
+// names up to FLASH_NAME_LEN - 1 characters, the length the rest of
+// the firmware already handles. A filesystem that outgrows either
+// limit doesn't break anything: the index just switches itself off and
+// everything falls back to scanning the directory as before, until a
+// delete or format gives it a chance to rebuild.
+#ifndef FLASH_DIR_INDEX_MAX
+#define FLASH_DIR_INDEX_MAX 256
+#endif
+#define FLASH_NAME_LEN 32
+
+typedef struct {
+	char name[FLASH_NAME_LEN];
+	uint32_t size;
+} dir_entry_t;
+
+static dir_entry_t dir_index[FLASH_DIR_INDEX_MAX];
+static int dir_count = 0;
+static bool dir_valid = false;
+
+// position of name in the index, or where it would be inserted
+static int dir_index_search(const char *name, bool *found) {
+	int lo = 0, hi = dir_count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		int cmp = strcmp(dir_index[mid].name, name);
+		if (cmp == 0) { *found = true; return mid; }
+		if (cmp < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	*found = false;
+	return lo;
+}
+
+static void dir_index_put(const char *name, uint32_t size) {
+
+	if (!dir_valid) return;
+
+	bool found;
+	int pos = dir_index_search(name, &found);
+	if (found) {
+		dir_index[pos].size = size;
+		return;
+	}
+
+	if (dir_count >= FLASH_DIR_INDEX_MAX || strlen(name) >= FLASH_NAME_LEN) {
+		dir_valid = false;	// outgrown -- scan instead from now on
+		return;
+	}
+
+	memmove(&dir_index[pos + 1], &dir_index[pos],
+		(dir_count - pos) * sizeof(dir_entry_t));
+	strcpy(dir_index[pos].name, name);
+	dir_index[pos].size = size;
+	dir_count++;
+
+}
+
+static void dir_index_remove(const char *name) {
+
+	if (!dir_valid) return;
+
+	bool found;
+	int pos = dir_index_search(name, &found);
+	if (!found) return;
+
+	memmove(&dir_index[pos], &dir_index[pos + 1],
+		(dir_count - pos - 1) * sizeof(dir_entry_t));
+	dir_count--;
+
+}
+
+// re-reads one name's directory entry after a write to it, whatever
+// the write's outcome -- a failed write may still have created or
+// truncated the file
+static void dir_index_refresh(const char *name) {
+	struct lfs_info info;
+	if (lfs_stat(&lfs, name, &info) == 0 && info.type == LFS_TYPE_REG)
+		dir_index_put(name, info.size);
+	else
+		dir_index_remove(name);
+}
+
+static void dir_index_build(void) {
+
+	dir_count = 0;
+	dir_valid = false;
+	if (!mounted) return;
+
+	lfs_dir_t dir;
+	if (lfs_dir_open(&lfs, &dir, "/") != 0) return;
+
+	dir_valid = true;
+	struct lfs_info info;
+	while (dir_valid && lfs_dir_read(&lfs, &dir, &info) > 0) {
+		if (info.type == LFS_TYPE_REG) dir_index_put(info.name, info.size);
+	}
+
+	lfs_dir_close(&lfs, &dir);
+
+	if (!dir_valid) dir_count = 0;
+
+}
+
+// ---- open read handles ----
+//
+// The viewer reads a file a line at a time and XMODEM send a block at
+// a time, each through flash_storage_read() -- and opening a littlefs
+// file means walking its metadata, then seeking means walking its CTZ
+// skip list from the head, on every single call. So the last few files
+// read stay open here, least recently used closed first, each with its
+// own cache buffer (littlefs's file cache, not the shared one in
+// flash_cfg) and a known position: a read that picks up where the
+// previous one left off -- the normal case for both -- needs no seek
+// at all, and one elsewhere in the same file is a seek from a handle
+// that's already open.
+//
+// A handle only ever reads, and must never see a file change
+// underneath it: every call in this file that writes, renames, deletes
+// or formats closes the affected handles first (read_handle_drop()).
+// FLASH_READ_HANDLES is a CMake cache variable; each one costs a
+// lfs_file_t plus a FS_PROG_SIZE cache, a little under 400 bytes.
+#ifndef FLASH_READ_HANDLES
+#define FLASH_READ_HANDLES 4
+#endif
+
+typedef struct {
+	bool open;
+	char name[FLASH_NAME_LEN];
+	lfs_file_t file;
+	uint8_t cache[FS_PROG_SIZE];
+	uint32_t pos;
+	uint32_t last_use;
+} read_handle_t;
+
+static read_handle_t read_handles[FLASH_READ_HANDLES];
+static uint32_t read_clock = 0;
+
+static void read_handle_close(read_handle_t *h) {
+	if (!h->open) return;
+	lfs_file_close(&lfs, &h->file);
+	h->open = false;
+}
+
+// closes any handle on name, or every handle if name is NULL
+static void read_handle_drop(const char *name) {
+	for (int i = 0; i < FLASH_READ_HANDLES; i++) {
+		read_handle_t *h = &read_handles[i];
+		if (h->open && (!name || strcmp(h->name, name) == 0))
+			read_handle_close(h);
+	}
+}
+
+// an open handle on name -- an existing one, or a newly opened one in
+// place of the least recently used. NULL if it can't be opened.
+static read_handle_t *read_handle_get(const char *name) {
+
+	read_handle_t *victim = &read_handles[0];
+
+	for (int i = 0; i < FLASH_READ_HANDLES; i++) {
+		read_handle_t *h = &read_handles[i];
+		if (h->open && strcmp(h->name, name) == 0) {
+			h->last_use = ++read_clock;
+			return h;
+		}
+		if (!h->open) victim = h;
+		else if (victim->open && h->last_use < victim->last_use) victim = h;
+	}
+
+	if (strlen(name) >= FLASH_NAME_LEN) return NULL;	// caller opens directly
+
+	read_handle_close(victim);
+
+	struct lfs_file_config cfg;
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.buffer = victim->cache;
+	if (lfs_file_opencfg(&lfs, &victim->file, name, LFS_O_RDONLY, &cfg) != 0)
+		return NULL;
+
+	strcpy(victim->name, name);
+	victim->open = true;
+	victim->pos = 0;
+	victim->last_use = ++read_clock;
+	return victim;
+
+}
+
+// reads from an open handle, seeking only if offset isn't where the
+// previous read left it
+static uint32_t read_handle_read(read_handle_t *h, uint32_t offset, char *buf,
+		uint32_t len) {
+
+	if (offset != h->pos) {
+		if (lfs_file_seek(&lfs, &h->file, offset, LFS_SEEK_SET) < 0) {
+			read_handle_close(h);	// unknown position -- start over next time
+			return 0;
+		}
+		h->pos = offset;
+	}
+
+	lfs_ssize_t got = lfs_file_read(&lfs, &h->file, buf, len);
+	if (got < 0) {
+		read_handle_close(h);
+		return 0;
+	}
+
+	h->pos += (uint32_t)got;
+	return (uint32_t)got;
+
+}
+
+// ---- streaming writer ----
+//
+// One file at a time is written incrementally: open, any number of
+// appends, close. Everything goes to FLASH_STREAM_TMP, and only close
+// renames it over the real name -- littlefs's rename is atomic, so
+// until then an existing file of that name is untouched, and a reset
+// (or an aborted upload) halfway through leaves the old file exactly
+// as it was rather than a truncated new one. The leftover temp file is
+// removed at the next mount.
+//
+// RAM cost is constant: the handle plus its own FS_PROG_SIZE cache
+// (static, so littlefs never mallocs one), whatever the file size --
+// free flash is the only limit.
+#define FLASH_STREAM_TMP ".stream.tmp"
+
+static struct {
+	bool open;
+	bool failed;		// a write failed -- close will discard, not commit
+	char name[FLASH_NAME_LEN];
+	lfs_file_t file;
+	uint8_t cache[FS_PROG_SIZE];
+} stream;
+
+bool flash_storage_stream_open(const char *name) {
+
+	if (!mounted || stream.open) return false;
+	if (strlen(name) >= FLASH_NAME_LEN) return false;
+
+	struct lfs_file_config cfg;
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.buffer = stream.cache;
+	if (lfs_file_opencfg(&lfs, &stream.file, FLASH_STREAM_TMP,
+			LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC, &cfg) != 0)
+		return false;
+
+	strcpy(stream.name, name);
+	stream.open = true;
+	stream.failed = false;
+	return true;
+
+}
+
+bool flash_storage_stream_append(const char *data, uint32_t len) {
+
+	if (!stream.open || stream.failed) return false;
+
+	lfs_ssize_t written = lfs_file_write(&lfs, &stream.file, data, len);
+	if (written != (lfs_ssize_t)len) stream.failed = true;
+
+	return !stream.failed;
+
+}
+
+bool flash_storage_stream_truncate(uint32_t len) {
+
+	if (!stream.open || stream.failed) return false;
+
+	if (lfs_file_truncate(&lfs, &stream.file, len) != 0) stream.failed = true;
+
+	return !stream.failed;
+
+}
+
+void flash_storage_stream_abort(void) {
+
+	if (!stream.open) return;
+
+	lfs_file_close(&lfs, &stream.file);
+	lfs_remove(&lfs, FLASH_STREAM_TMP);
+	stream.open = false;
+
+}
+
+bool flash_storage_stream_close(void) {
+
+	if (!stream.open) return false;
+
+	if (stream.failed) {
+		flash_storage_stream_abort();
+		return false;
+	}
+
+	stream.open = false;
+
+	if (lfs_file_close(&lfs, &stream.file) != 0) {
+		lfs_remove(&lfs, FLASH_STREAM_TMP);
+		return false;
+	}
+
+	uint32_t old_size = 0, new_size = 0;
+	bool had_old = flash_storage_file_size(stream.name, &old_size);
+
+	struct lfs_info info;
+	if (lfs_stat(&lfs, FLASH_STREAM_TMP, &info) == 0) new_size = info.size;
+
+	read_handle_drop(stream.name);
+	if (lfs_rename(&lfs, FLASH_STREAM_TMP, stream.name) != 0) {
+		lfs_remove(&lfs, FLASH_STREAM_TMP);
+		return false;
+	}
+
+	dir_index_refresh(stream.name);
+	used_adjust(had_old, old_size, new_size);
+	return true;
+
+}
+
 void flash_storage_init(void) {
 
+	// optional -- without one, bulk reads just stay on the cached path
+	if (stream_dma < 0) stream_dma = dma_claim_unused_channel(false);
+
 	int err = lfs_mount(&lfs, &flash_cfg);
 
 	if (err) {
@@ -160,11 +819,23 @@ void flash_storage_init(void) {
 
 	mounted = (err == 0);
 
+	// a stream that never got to close (reset mid-upload) -- its temp
+	// file is all that's left of it, and is of no use to anyone
+	if (mounted) lfs_remove(&lfs, FLASH_STREAM_TMP);
+
+	dir_index_build();
+	if (mounted) used_recount(NULL);
+
 }
 
 bool flash_storage_format(void) {
 
 	if (mounted) {
+		read_handle_drop(NULL);
+		if (stream.open) {
+			lfs_file_close(&lfs, &stream.file);
+			stream.open = false;
+		}
 		lfs_unmount(&lfs);
 		mounted = false;
 	}
@@ -173,6 +844,8 @@ bool flash_storage_format(void) {
 	if (lfs_mount(&lfs, &flash_cfg) != 0) return false;
 
 	mounted = true;
+	dir_index_build();
+	used_recount(NULL);
 	return true;
 
 }
@@ -180,6 +853,7 @@ bool flash_storage_format(void) {
 int flash_storage_file_count(void) {
 
 	if (!mounted) return 0;
+	if (dir_valid) return dir_count;
 
 	lfs_dir_t dir;
 	if (lfs_dir_open(&lfs, &dir, "/") != 0) return 0;
@@ -201,6 +875,14 @@ bool flash_storage_file_info(int idx, char *name_out, int name_out_len,
 
 	if (!mounted || idx < 0) return false;
 
+	if (dir_valid) {
+		if (idx >= dir_count) return false;
+		strncpy(name_out, dir_index[idx].name, name_out_len - 1);
+		name_out[name_out_len - 1] = 0;
+		*size_out = dir_index[idx].size;
+		return true;
+	}
+
 	lfs_dir_t dir;
 	if (lfs_dir_open(&lfs, &dir, "/") != 0) return false;
 
@@ -239,6 +921,16 @@ int flash_storage_file_info_range(int start_idx, int count,
 
 	if (!mounted || start_idx < 0 || count <= 0) return 0;
 
+	if (dir_valid) {
+		int filled = 0;
+		for (int i = start_idx; i < dir_count && filled < count; i++) {
+			strcpy(names_out[filled], dir_index[i].name);
+			sizes_out[filled] = dir_index[i].size;
+			filled++;
+		}
+		return filled;
+	}
+
 	lfs_dir_t dir;
 	if (lfs_dir_open(&lfs, &dir, "/") != 0) return 0;
 
@@ -265,6 +957,13 @@ bool flash_storage_file_size(const char *name, uint32_t *size_out) {
 
 	if (!mounted) return false;
 
+	if (dir_valid) {
+		bool found;
+		int pos = dir_index_search(name, &found);
+		if (found) *size_out = dir_index[pos].size;
+		return found;
+	}
+
 	struct lfs_info info;
 	if (lfs_stat(&lfs, name, &info) != 0) return false;
 	if (info.type != LFS_TYPE_REG) return false;
@@ -279,6 +978,10 @@ uint32_t flash_storage_read(const char *name, uint32_t offset, char *buf,
 
 	if (!mounted) return 0;
 
+	read_handle_t *h = read_handle_get(name);
+	if (h) return read_handle_read(h, offset, buf, len);
+
+	// too long a name to keep a handle for -- one-off open
 	lfs_file_t file;
 	if (lfs_file_open(&lfs, &file, name, LFS_O_RDONLY) != 0) return 0;
 
@@ -291,32 +994,267 @@ uint32_t flash_storage_read(const char *name, uint32_t offset, char *buf,
 
 }
 
+uint32_t flash_storage_read_vec(const char *name, flash_seg_t *segs, int count) {
+
+	if (!mounted) return 0;
+
+	read_handle_t *h = read_handle_get(name);
+	if (h) {
+		uint32_t total = 0;
+		for (int i = 0; i < count; i++) {
+			segs[i].len = read_handle_read(h, segs[i].offset, segs[i].buf, segs[i].len);
+			total += segs[i].len;
+			if (!h->open) {		// a failed seek/read closed it
+				for (i++; i < count; i++) segs[i].len = 0;
+				break;
+			}
+		}
+		return total;
+	}
+
+	lfs_file_t file;
+	if (lfs_file_open(&lfs, &file, name, LFS_O_RDONLY) != 0) return 0;
+
+	uint32_t total = 0;
+	for (int i = 0; i < count; i++) {
+		lfs_ssize_t got = 0;
+		if (lfs_file_seek(&lfs, &file, segs[i].offset, LFS_SEEK_SET) >= 0)
+			got = lfs_file_read(&lfs, &file, segs[i].buf, segs[i].len);
+		segs[i].len = got > 0 ? (uint32_t)got : 0;
+		total += segs[i].len;
+	}
+
+	lfs_file_close(&lfs, &file);
+
+	return total;
+
+}
+
+// the whole-file case of the above -- so it gets the same atomic
+// replace, not an O_TRUNC that loses the old file if anything fails
 bool flash_storage_write_file(const char *name, const char *data,
 		uint32_t len) {
 
-	if (!mounted) return false;
+	if (!flash_storage_stream_open(name)) return false;
+
+	flash_storage_stream_append(data, len);
+
+	return flash_storage_stream_close();
+
+}
+
+// ---- in-place range writes ----
+//
+// Overwrites bytes of an existing file where they are, through one
+// O_WRONLY handle (no O_TRUNC): seek, write, close. The file is never
+// grown or shortened -- anything past its end is clipped off -- and
+// nothing is staged in RAM, so changing a few bytes of a file of any
+// size costs a few bytes of RAM.
+//
+// What it costs in flash follows from littlefs's CTZ layout: a file's
+// blocks are a backwards skip-list, each block pointing at earlier
+// ones, so a changed block means a new copy of it and of every block
+// after it, and the close copies the rest of the file over (the front
+// of the first changed block too). A fix near the end of a big log is
+// a few page programs; the same fix near the start rewrites most of
+// the file -- still far cheaper than the stream-and-rename of a
+// whole-file rewrite, and still power-safe: a power loss before the
+// close commits leaves the file exactly as it was. A failure the code
+// sees is another matter: littlefs can't abandon a handle's changes,
+// so the close commits whatever was written before it. Everything
+// that can be checked up front -- segment order, the gaps' source --
+// is checked before the handle opens, leaving only flash errors (or a
+// full partition) to fail partway.
+//
+// That tail copy happens on every seek of a handle that has written,
+// not just at the close -- so segments go in ascending order through
+// ONE pass, with the unchanged bytes between two segments copied
+// across from the committed file by this code rather than seeked over.
+// However many segments, the tail is copied once.
+static uint8_t range_cache[FS_PROG_SIZE];
+static char range_gap[FS_PROG_SIZE];
+
+uint32_t flash_storage_write_vec(const char *name, const flash_seg_t *segs,
+		int count) {
 
+	if (!mounted) return 0;
+
+	uint32_t size;
+	if (!flash_storage_file_size(name, &size)) return 0;
+
+	int first = 0;
+	while (first < count && (segs[first].offset >= size || segs[first].len == 0))
+		first++;
+	if (first == count) return 0;
+
+	// ascending and non-overlapping, or nothing is written at all
+	uint64_t end = 0;
+	bool gaps = false;
+	for (int i = 0; i < count; i++) {
+		if (segs[i].len == 0) continue;
+		if (segs[i].offset < end) return 0;
+		if (i > first && segs[i].offset > end && segs[i].offset < size)
+			gaps = true;
+		end = (uint64_t)segs[i].offset + segs[i].len;
+	}
+
+	// the gaps come from the committed file, which a read handle still
+	// sees unchanged -- nothing is committed until the close
+	read_handle_t *src = NULL;
+	if (gaps && !(src = read_handle_get(name))) return 0;
+
+	struct lfs_file_config cfg;
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.buffer = range_cache;
 	lfs_file_t file;
-	int err = lfs_file_open(&lfs, &file, name,
-		LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
-	if (err != 0) return false;
+	if (lfs_file_opencfg(&lfs, &file, name, LFS_O_WRONLY, &cfg) != 0) return 0;
 
-	lfs_ssize_t written = lfs_file_write(&lfs, &file, data, len);
+	bool ok = lfs_file_seek(&lfs, &file, segs[first].offset, LFS_SEEK_SET) >= 0;
+	uint32_t pos = segs[first].offset, total = 0;
 
-	lfs_file_close(&lfs, &file);
+	for (int i = first; ok && i < count; i++) {
+
+		uint32_t off = segs[i].offset, len = segs[i].len;
+		if (len == 0) continue;
+		if (off >= size) break;
+		if (len > size - off) len = size - off;
 
-	return written == (lfs_ssize_t)len;
+		while (ok && pos < off) {
+			uint32_t n = off - pos;
+			if (n > sizeof(range_gap)) n = sizeof(range_gap);
+			ok = read_handle_read(src, pos, range_gap, n) == n &&
+				lfs_file_write(&lfs, &file, range_gap, n) == (lfs_ssize_t)n;
+			pos += n;
+		}
+
+		if (ok) ok = lfs_file_write(&lfs, &file, segs[i].buf, len) ==
+			(lfs_ssize_t)len;
+		pos += len;
+		total += len;
+
+	}
+
+	// closing with ok false still commits whatever did get written --
+	// littlefs has no way to abandon a handle's changes -- so report
+	// nothing written rather than guess how much of it landed
+	if (lfs_file_close(&lfs, &file) != 0) ok = false;
 
+	read_handle_drop(name);
+	return ok ? total : 0;
+
+}
+
+uint32_t flash_storage_write_range(const char *name, uint32_t offset,
+		const char *data, uint32_t len) {
+	flash_seg_t seg = { offset, (char *)data, len };
+	return flash_storage_write_vec(name, &seg, 1);
 }
 
 bool flash_storage_rename(const char *old_name, const char *new_name) {
 	if (!mounted) return false;
-	return lfs_rename(&lfs, old_name, new_name) == 0;
+	read_handle_drop(old_name);
+	read_handle_drop(new_name);
+
+	uint32_t replaced_size = 0;
+	bool replaces = strcmp(old_name, new_name) != 0 &&
+		flash_storage_file_size(new_name, &replaced_size);
+
+	bool ok = lfs_rename(&lfs, old_name, new_name) == 0;
+	if (ok) {
+		dir_index_remove(old_name);
+		dir_index_refresh(new_name);
+		if (replaces) used_adjust(true, replaced_size, 0);
+	}
+	return ok;
+}
+
+// ---- zero-copy reads ----
+//
+// A file's data lives in its CTZ blocks in flash, which is memory-
+// mapped at XIP_BASE -- so a caller that only needs to look at some
+// bytes can be handed a pointer straight to them instead of a copy.
+// littlefs's own file handle knows, once it has read a byte, which
+// block that byte was in and where (file.block, file.off), so one
+// single-byte read through a cached handle (no seek if it's already
+// there) locates offset. The window runs from there to the end of that
+// block or of the file, whichever comes first: the next block is
+// somewhere else entirely, and starts with skip-list pointers anyway,
+// so no window ever crosses a block boundary. A file small enough to
+// be stored inline in its directory's metadata has no block of its
+// own to point into, and is never mapped.
+bool flash_storage_map(const char *name, uint32_t offset,
+		const uint8_t **ptr, uint32_t *len) {
+
+	if (!mounted) return false;
+
+	read_handle_t *h = read_handle_get(name);
+	if (!h) return false;
+
+	char byte;
+	if (read_handle_read(h, offset, &byte, 1) != 1) return false;
+	if (h->file.flags & LFS_F_INLINE) return false;
+
+	// flash must hold what the window shows -- and only a pending
+	// batch could make it not (see write batching)
+	if (batch_flush() != 0) return false;
+
+	uint32_t at = h->file.off - 1;		// the byte just read
+	uint32_t n = FS_BLOCK_SIZE - at;
+
+	uint32_t size;
+	if (flash_storage_file_size(name, &size) && size - offset < n)
+		n = size - offset;
+
+	*ptr = (const uint8_t *)(XIP_BASE + FLASH_TARGET_OFFSET +
+		h->file.block * FS_BLOCK_SIZE + at);
+	*len = n;
+	return true;
+
+}
+
+// position of name in the file list (the index
+// flash_storage_file_info() takes), or -1 if there's no such file
+int flash_storage_find(const char *name) {
+
+	if (!mounted) return -1;
+
+	if (dir_valid) {
+		bool found;
+		int pos = dir_index_search(name, &found);
+		return found ? pos : -1;
+	}
+
+	// no index: the position is how many regular files come before it
+	lfs_dir_t dir;
+	if (lfs_dir_open(&lfs, &dir, "/") != 0) return -1;
+
+	struct lfs_info info;
+	int seen = 0, pos = -1;
+	while (lfs_dir_read(&lfs, &dir, &info) > 0) {
+		if (info.type != LFS_TYPE_REG) continue;
+		if (strcmp(info.name, name) == 0) { pos = seen; break; }
+		seen++;
+	}
+
+	lfs_dir_close(&lfs, &dir);
+	return pos;
+
 }
 
 bool flash_storage_delete(const char *name) {
 	if (!mounted) return false;
-	return lfs_remove(&lfs, name) == 0;
+	read_handle_drop(name);
+
+	uint32_t size = 0;
+	bool had = flash_storage_file_size(name, &size);
+
+	bool ok = lfs_remove(&lfs, name) == 0;
+	if (ok) {
+		if (dir_valid) dir_index_remove(name);
+		else dir_index_build();		// may fit again now
+		used_adjust(had, size, 0);
+	}
+	return ok;
 }
 
 uint32_t flash_storage_total(void) {
@@ -327,12 +1265,172 @@ uint32_t flash_storage_free(void) {
 
 	if (!mounted) return 0;
 
-	lfs_ssize_t used_blocks = lfs_fs_size(&lfs);
-	if (used_blocks < 0) return 0;
+	if (used_blocks < 0 && used_recount(NULL) != 0) return 0;
+
+	int32_t blocks = used_blocks;
 
-	uint32_t used = (uint32_t)used_blocks * flash_cfg.block_size;
+	// a file being streamed isn't in the count until it's closed, but
+	// its blocks are already gone
+	if (stream.open) {
+		lfs_soff_t size = lfs_file_size(&lfs, &stream.file);
+		if (size > 0) blocks += file_blocks((uint32_t)size);
+	}
+
+	uint32_t used = (uint32_t)blocks * flash_cfg.block_size;
 	uint32_t total = flash_storage_total();
 
 	return used > total ? 0 : total - used;
 
 }
+
+// ---- idle maintenance ----
+//
+// Core1 spends most of its time in editor_yield() waiting for a key;
+// flash_storage_idle() is called from there when nothing has arrived
+// for a while, and uses that time to take work off the next foreground
+// write, one short step per call:
+//
+//   1. a traversal marking every block littlefs is using -- which also
+//      re-verifies the used-block count (see used_recount()).
+//   2. the rest -- free blocks -- blank-checked a few at a time, and
+//      any that still hold old data (a deleted or rewritten file's)
+//      erased, one per step, and recorded in pre_erased.
+//
+// rp2040_erase() skips only blocks recorded there, so a snapshot, an
+// XMODEM upload or a te save that lands on pre-erased blocks pays for
+// none of those erases. A free block that merely reads blank is left
+// alone here and erased for real when littlefs asks -- it may be the
+// remains of an interrupted erase, and erasing every such block once
+// per boot just to vouch for it would cost more wear than it saves.
+// Any program or erase outside of this (idle_stale) means the
+// used-block map can't be trusted, so it starts again from step 1
+// next time; so does anything still open for writing, which waits
+// until it's closed.
+//
+// The caller's input_pending() is asked between every unit of work --
+// each block the traversal visits, each block blank-checked -- and a
+// true answer ends the step on the spot. A traversal cut short that
+// way starts over next time (littlefs can't resume one), which is
+// fine: it's only reads. So a keypress waits behind at most one block
+// read, or one ~45ms erase already under way. lfs_fs_gc() isn't called
+// for the same reason: its metadata compaction can't be interrupted
+// once started, and littlefs does it on its own when a write needs it.
+#define IDLE_CHECK_PER_STEP 8
+
+static enum { IDLE_MAP, IDLE_ERASE, IDLE_DONE } idle_step = IDLE_MAP;
+static uint32_t idle_next = 0;
+
+static void idle_erase_op(void *param) {
+	flash_range_erase(*(uint32_t *)param, FS_BLOCK_SIZE);
+}
+
+bool flash_storage_idle(bool (*input_pending)(void)) {
+
+	if (!mounted || stream.open) return false;
+
+	if (idle_stale) {
+		idle_stale = false;
+		idle_step = IDLE_MAP;
+	}
+
+	if (idle_step == IDLE_DONE) return false;
+
+	idle_active = true;
+
+	switch (idle_step) {
+
+		case IDLE_MAP: {
+			int err = used_recount(input_pending);
+			if (err == USED_STOPPED) break;		// from the top, next time
+			if (err) {
+				idle_step = IDLE_DONE;		// try again after the next write
+				break;
+			}
+			idle_next = 0;
+			idle_step = IDLE_ERASE;
+			break;
+		}
+
+		case IDLE_ERASE:
+			for (int n = 0; n < IDLE_CHECK_PER_STEP; n++) {
+				if (input_pending && input_pending()) break;
+				if (idle_next >= FS_BLOCK_COUNT) {
+					idle_step = IDLE_DONE;
+					break;
+				}
+				uint32_t block = idle_next++;
+				if (used_map[block / 32] & (1u << (block % 32))) continue;
+				uint32_t addr = FLASH_TARGET_OFFSET + block * FS_BLOCK_SIZE;
+				if (block_blank(addr)) continue;
+				rcache_invalidate(addr, FS_BLOCK_SIZE);
+				if (flash_safe_execute(idle_erase_op, &addr,
+						FLASH_SAFE_TIMEOUT_MS) == PICO_OK) {
+					pre_erased[block / 32] |= 1u << (block % 32);
+					stats.idle_erases++;
+				}
+				break;	// one erase per step
+			}
+			break;
+
+		default:
+			break;
+
+	}
+
+	idle_active = false;
+
+	return idle_step != IDLE_DONE;
+
+}
+
+// ---- bulk read benchmark ----
+//
+// Reads all of `name` twice, FLASH_BENCH_CHUNK bytes at a time: first
+// with bulk reads forced onto the cached memcpy() path, then through
+// the XIP stream. Each pass starts with the XIP cache flushed and its
+// hit/access counters cleared, so its misses are everything that pass
+// (and whatever core0 ran meanwhile) had to fetch from flash -- data
+// and evicted code alike on the cached pass, code alone on the
+// streamed one.
+#define FLASH_BENCH_CHUNK 4096
+
+bool flash_storage_bench(const char *name, flash_bench_t *out) {
+
+	uint32_t size;
+	if (!flash_storage_file_size(name, &size)) return false;
+
+	char *buf = malloc(FLASH_BENCH_CHUNK);
+	if (!buf) return false;
+
+	memset(out, 0, sizeof(*out));
+	out->bytes = size;
+	out->streamed = stream_dma >= 0;
+
+	bool ok = true;
+
+	for (int pass = 0; pass < 2 && ok; pass++) {
+
+		stream_enabled = (pass == 1);
+		read_handle_drop(name);		// each pass opens the file afresh
+
+		xip_ctrl_hw->flush = 1;
+		while (!(xip_ctrl_hw->stat & XIP_STAT_FLUSH_RDY)) { }
+		xip_ctrl_hw->ctr_hit = 0;	// any write clears them
+		xip_ctrl_hw->ctr_acc = 0;
+
+		uint32_t t0 = time_us_32();
+		for (uint32_t off = 0; off < size; off += FLASH_BENCH_CHUNK) {
+			uint32_t n = size - off;
+			if (n > FLASH_BENCH_CHUNK) n = FLASH_BENCH_CHUNK;
+			if (flash_storage_read(name, off, buf, n) != n) { ok = false; break; }
+		}
+		out->us[pass] = time_us_32() - t0;
+		out->xip_misses[pass] = xip_ctrl_hw->ctr_acc - xip_ctrl_hw->ctr_hit;
+
+	}
+
+	stream_enabled = true;
+	free(buf);
+	return ok;
+
+}
@@ -21,12 +21,18 @@
  * pico-sdk behavior but are the one part of this file that genuinely
  * needs a first real-hardware test before being trusted.
  *
- * Flash is read-only from every editing mode in this firmware (FRAM is
- * the only writable target) -- the one exception is a whole-file write,
- * used only by the FRAM snapshot feature (and, later, file upload).
- * There is no per-byte flash write path, deliberately: littlefs's own
- * caching makes per-byte writes expensive, and nothing in this UI needs
- * them.
+ * Files are written two ways: whole, through the streaming writer
+ * below (the FRAM snapshot, te, XMODEM upload and SRWP), which
+ * atomically replaces the file on close; or in place, through
+ * flash_storage_write_range()/_vec(), which overwrite bytes of an
+ * existing file without changing its size -- what the grid editor's
+ * flash buffer commits through, and what CTRL-E from the viewer leads
+ * to. An in-place update rewrites everything from the first changed
+ * byte to the end of the file (littlefs's CTZ layout, see
+ * flash_storage.c), so edits near the end are cheap and ones near the
+ * start of a big file cost nearly a whole rewrite. There is no
+ * per-byte write path, deliberately: at that cost per call, callers
+ * batch their edits into one update instead.
  */
 
 void flash_storage_init(void);		// mount, or format+mount if invalid
@@ -38,18 +44,85 @@ bool flash_storage_file_info(int idx, char *name_out, int name_out_len,
 int flash_storage_file_info_range(int start_idx, int count,
 	char names_out[][32], uint32_t *sizes_out);
 
-// direct name-based lookup (lfs_stat), not an index scan -- returns
-// false if the file doesn't exist. Used anywhere a caller has a
+// listing, counting and the lookups below are served from an in-RAM
+// directory index (see flash_storage.c) -- no flash access at all.
+// flash_storage_find() gives a name's position in the list, -1 if
+// there's no such file.
+int flash_storage_find(const char *name);
+
+// name lookup in the directory index above (a binary search, no flash
+// access), falling back to lfs_stat only when there's no valid index
+// (more files than FLASH_DIR_INDEX_MAX, or a directory scan that
+// failed) -- returns false if the file doesn't exist. Used anywhere a caller has a
 // filename in hand and needs to know it's real before acting on it
 // (e.g. te's fs_size(), and the pre-flight check before ever invoking
 // te_edit() at all).
 bool flash_storage_file_size(const char *name, uint32_t *size_out);
 
+// Reads through a small cache of open handles (see flash_storage.c):
+// a read that continues where the last one on the same file stopped
+// costs no open and no seek.
 uint32_t flash_storage_read(const char *name, uint32_t offset, char *buf,
 	uint32_t len);
+
+// one segment of a scatter/gather read: len bytes at offset into buf
+typedef struct {
+	uint32_t offset;
+	char *buf;
+	uint32_t len;
+} flash_seg_t;
+
+// reads every segment of `name` through ONE open handle -- one
+// lfs_file_open() (and its metadata walk) for the whole batch instead
+// of one per segment. Each segment's len is updated to what was
+// actually read (short at end of file). Returns the total.
+uint32_t flash_storage_read_vec(const char *name, flash_seg_t *segs, int count);
+
+// Zero-copy read: points *ptr straight at `name`'s data at `offset`,
+// in memory-mapped flash, for *len bytes -- as far as the data is
+// contiguous there, which is at most to the end of one 4KB flash block
+// (so callers wanting more map again from offset + *len). False if it
+// can't be mapped -- an inline (tiny) file, or offset at or past the
+// end -- and the caller should flash_storage_read() instead. The window
+// is read-only and valid only until the next flash write of any kind
+// (write, stream, rename, delete, format, idle maintenance): use it
+// right away, never keep it.
+bool flash_storage_map(const char *name, uint32_t offset,
+	const uint8_t **ptr, uint32_t *len);
+
+// Streaming writer: builds a file a piece at a time, in constant RAM,
+// so a file never has to fit in memory to be written. Goes to a temp
+// file until close, which atomically replaces `name` with it -- if
+// anything fails (or the stream is aborted) before then, an existing
+// `name` is left exactly as it was. One stream at a time: open fails
+// while another is open. After a failed append or truncate, every
+// further call fails and close discards the file.
+bool flash_storage_stream_open(const char *name);
+bool flash_storage_stream_append(const char *data, uint32_t len);
+bool flash_storage_stream_truncate(uint32_t len);	// shortens what's written so far
+bool flash_storage_stream_close(void);				// commits; false if nothing was
+void flash_storage_stream_abort(void);
+
+// whole-file write, through the streaming writer above (so it's an
+// atomic replace too) -- for data that's already in RAM anyway
 bool flash_storage_write_file(const char *name, const char *data,
 	uint32_t len);
 
+// In-place update: overwrites bytes of an existing file where they
+// are, without rewriting it from the start -- clipped at the end of
+// the file, which never grows or shrinks. The vectored form takes its
+// segments in ascending, non-overlapping order and writes them all in
+// one pass -- out of order, nothing is written. Returns the bytes
+// written, 0 on any failure (a flash error partway leaves the file
+// holding some unknown mix of old and new bytes in the range(s), and
+// nothing outside them changes). Cost is roughly the file from
+// the first changed byte to its end -- see flash_storage.c -- so
+// edits near the end are the cheap ones.
+uint32_t flash_storage_write_range(const char *name, uint32_t offset,
+	const char *data, uint32_t len);
+uint32_t flash_storage_write_vec(const char *name, const flash_seg_t *segs,
+	int count);
+
 // renames/moves a file. If a file already exists at `new_name`, it is
 // silently replaced (this is littlefs's own lfs_rename() behavior, not
 // something layered on here -- callers that care should check
@@ -60,7 +133,53 @@ bool flash_storage_rename(const char *old_name, const char *new_name);
 // deletes a file. False if it didn't exist or the delete failed.
 bool flash_storage_delete(const char *name);
 
+// free space from a cached used-block count (see flash_storage.c) --
+// cheap enough for every status-line redraw, never a traversal
 uint32_t flash_storage_free(void);
 uint32_t flash_storage_total(void);
 
+// running totals since boot: page programs and block erases littlefs
+// asked for, and the flash_safe_execute() lockouts they actually took
+// (each one parks core0 and flushes the XIP cache). Programs and
+// erases are batched into as few lockouts as possible -- without
+// batching, lockouts would equal progs + erases.
+// erases_skipped counts erases that didn't need doing because
+// flash_storage_idle() had already erased the block since boot (its
+// own erases are idle_erases, not counted in lockouts). cache_hits and
+// cache_misses are page reads served by the read cache, and ones that
+// had to go to flash.
+typedef struct {
+	uint32_t progs;
+	uint32_t erases;
+	uint32_t lockouts;
+	uint32_t erases_skipped;
+	uint32_t idle_erases;
+	uint32_t cache_hits;
+	uint32_t cache_misses;
+} flash_stats_t;
+
+void flash_storage_stats(flash_stats_t *out);
+
+// reads a whole file with bulk reads on the cached XIP path, then
+// again through the XIP stream (see flash_storage.c), timing each pass
+// and counting its XIP cache misses -- [0] is cached, [1] streamed.
+// streamed is false if no DMA channel was available, in which case
+// both passes took the cached path.
+typedef struct {
+	uint32_t bytes;
+	bool streamed;
+	uint32_t us[2];
+	uint32_t xip_misses[2];
+} flash_bench_t;
+
+bool flash_storage_bench(const char *name, flash_bench_t *out);
+
+// one short step of background maintenance (mapping the blocks in use,
+// then erasing free ones ahead of time so later writes don't wait on
+// it) -- see flash_storage.c. For idle time only: input_pending (may be
+// NULL) is asked between every block's worth of work, and the step
+// ends as soon as it says true. Returns false once there's nothing
+// left to do until the filesystem next changes. Never mounts.
+bool flash_storage_idle(bool (*input_pending)(void));
+
 #endif
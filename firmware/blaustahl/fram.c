@@ -4,14 +4,376 @@
  *
  */
 
+#include <string.h>
+
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "pico/multicore.h"
+#include "pico/mutex.h"
+#include "hardware/sync.h"
 
 #include "blaustahl.h"
 #include "fram.h"
+#include "fram_dma.h"
+
+// chip geometry, detected once by fram_init() from the RDID response
+// (see fram_detect()), so one firmware image drives both the 8KB
+// Blaustahl and 256KB Kaltstahl parts at their full capacity. Until
+// then -- and for parts that don't answer RDID at all -- the
+// compile-time FRAM_SIZE default applies.
+static uint32_t fram_bytes = FRAM_SIZE;
+static bool fram_addr3 = (FRAM_SIZE > 65536);	// 3-byte addressing
+static uint8_t fram_id[4];
+static bool fram_id_ok = false;
+
+// SPI clock and read opcode, chosen by fram_calibrate() at boot --
+// see there. Until then, the conservative FRAM_CLK_SAFE_HZ with plain
+// READ, which every MB85RS part supports.
+static uint32_t fram_clk_hz = FRAM_CLK_SAFE_HZ;
+static uint32_t fram_rated_hz = FRAM_CLK_SAFE_HZ;	// the part's datasheet
+													// max, from fram_detect()
+static bool fram_fast = false;		// FAST READ (0x0B) instead of READ (0x03)
+
+// opcode + 2- or 3-byte big-endian address into cmd (room for 4),
+// returns the header length
+static int fram_cmd(uint8_t *cmd, uint8_t op, uint32_t addr) {
+	cmd[0] = op;
+	if (fram_addr3) {
+		cmd[1] = addr >> 16;
+		cmd[2] = addr >> 8;
+		cmd[3] = addr & 0xff;
+		return 4;
+	}
+	cmd[1] = addr >> 8;
+	cmd[2] = addr & 0xff;
+	return 3;
+}
+
+// READ or FAST READ header: FAST READ is the same frame plus one dummy
+// byte between the address and the first data byte (room for 5)
+static int fram_read_cmd(uint8_t *cmd, uint32_t addr, bool fast) {
+	int n = fram_cmd(cmd, fast ? 0x0b : 0x03, addr);
+	if (fast) cmd[n++] = 0x00;
+	return n;
+}
+
+// write-through RAM mirror of the whole chip, for parts no bigger than
+// FRAM_MIRROR_SIZE (a CMake cache variable, 0 compiles it out). Loaded
+// once by fram_init() -- the first access, and before core1 or the USB
+// vendor path exist, so nothing can race the load -- and from then on
+// every write path in this file updates it before (or, for the async
+// path, instead of waiting for) the chip, so it always holds the
+// chip's logical content. fram_read() is then a memcpy: no SPI
+// transaction, no waiting behind an async transfer, and no bus
+// contention between core1's editor and core0's vendor reads. The
+// chip remains the only durable copy -- the mirror is never written
+// back, only ever refreshed from it at boot.
+#ifndef FRAM_MIRROR_SIZE
+#define FRAM_MIRROR_SIZE 8192
+#endif
+
+#if FRAM_MIRROR_SIZE > 0
+static uint8_t fram_mirror[FRAM_MIRROR_SIZE];
+#endif
+static bool mirror_on = false;
+
+static inline void mirror_update(uint32_t addr, const uint8_t *buf, uint32_t len) {
+#if FRAM_MIRROR_SIZE > 0
+	if (mirror_on && addr < fram_bytes && len <= fram_bytes - addr)
+		memcpy(&fram_mirror[addr], buf, len);
+#endif
+}
+
+// DMA channels for fram_dma.c's asynchronous transfers, claimed once
+// in fram_init(). Both are always used together: SPI is full-duplex,
+// so even a pure write has to have its RX side drained (into
+// dma_rx_sink) or the RX FIFO overflows after 8 bytes, and even a pure
+// read has to have something clocking bytes out (dma_tx_zero, read
+// without incrementing).
+static int dma_tx = -1;
+static int dma_rx = -1;
+static const uint8_t dma_tx_zero = 0x00;
+static uint8_t dma_rx_sink;
+
+// the SPI bus, shared by both cores: core1 (editor, storage, SRWP,
+// and the DMA queue) and core0 (the USB vendor commands, and draining
+// the write-behind queue below). Held for exactly one transaction at a
+// time -- a blocking transfer, one write-behind burst, or an
+// asynchronous DMA transfer from fram_dma_port_start() until
+// fram_dma_port_finish() raises CS again, which is what keeps core0
+// off the bus while core1's DMA owns it.
+static mutex_t fram_bus;
+
+// ---- write-behind queue ----
+//
+// Immediate-mode editing on core1 doesn't wait for the chip: each
+// keystroke's byte goes into this single-producer (core1),
+// single-consumer (core0) ring and core0 writes it out between
+// tud_task() passes, a run of consecutive addresses as one burst.
+// Lock-free: only core1 advances wb_head and only core0 advances
+// wb_tail, and wb_tail only moves past an entry once it is on the
+// chip -- so an empty queue means every queued byte is durable.
+//
+// Reads see pending bytes: from the mirror when it's on (updated at
+// enqueue time, like every other write path), and otherwise by
+// overlaying whatever is still queued onto what the chip returned
+// (fram_read()). Every other write path on core1 drains the queue
+// first (fram_settle()), so nothing can overtake a queued byte.
+#define FRAM_WB_LEN 256		// entries, power of two
+#define FRAM_WB_BURST 64	// longest run core0 writes in one go
+
+static uint32_t wb_addr[FRAM_WB_LEN];
+static uint8_t wb_data[FRAM_WB_LEN];
+static volatile uint32_t wb_head = 0;	// next slot core1 fills
+static volatile uint32_t wb_tail = 0;	// next slot core0 writes out
+
+static void fram_write_range_raw(uint32_t addr, const uint8_t *buf, int len);
+
+// core0: writes out one run of consecutive queued addresses, false if
+// there was nothing to do
+static bool wb_drain_run(void) {
+
+	uint32_t t = wb_tail;
+	uint32_t h = wb_head;
+	if (t == h) return false;
+	__mem_fence_acquire();	// entries written before core1 published h
+
+	uint8_t burst[FRAM_WB_BURST];
+	uint32_t start = wb_addr[t % FRAM_WB_LEN];
+	uint32_t n = 0;
+	while (t + n != h && n < FRAM_WB_BURST &&
+			wb_addr[(t + n) % FRAM_WB_LEN] == start + n) {
+		burst[n] = wb_data[(t + n) % FRAM_WB_LEN];
+		n++;
+	}
+
+	mutex_enter_blocking(&fram_bus);
+	fram_write_range_raw(start, burst, (int)n);
+	mutex_exit(&fram_bus);
+
+	__mem_fence_release();
+	wb_tail = t + n;
+	return true;
+
+}
+
+// core1: waits until core0 has written out everything queued so far
+static void wb_flush(void) {
+	while (wb_tail != wb_head) tight_loop_contents();
+}
+
+// every blocking entry point below calls this first, so that a
+// blocking access issued after an asynchronous or write-behind write
+// always sees that write land first. On core1 -- which owns both
+// queues -- that means draining them: core0 empties the write-behind
+// queue while this waits, and the DMA queue is driven to completion
+// here. On core0 it means writing out whatever core1 has queued
+// (core0 is that queue's consumer); a DMA transfer in flight just
+// keeps the bus mutex until it finishes.
+static void fram_settle(void) {
+	if (get_core_num() == 1) {
+		wb_flush();
+		fram_dma_wait_idle();
+	} else {
+		while (wb_drain_run()) ;
+	}
+}
+
+static void fram_write_enable_raw(void) {
+
+	uint8_t cmdbuf[1] = { 0x06 };
+
+	gpio_put(BS_FRAM_SS, 0);
+	spi_write_blocking(BS_FRAM_SPI, cmdbuf, 1); // WREN
+	gpio_put(BS_FRAM_SS, 1);
+
+}
+
+static void fram_read_raw(uint8_t *buf, uint32_t addr, int len, bool fast) {
+
+	uint8_t cmdbuf[5];
+	int n = fram_read_cmd(cmdbuf, addr, fast);
+
+	gpio_put(BS_FRAM_SS, 0);
+	spi_write_blocking(BS_FRAM_SPI, cmdbuf, n);
+	spi_read_blocking(BS_FRAM_SPI, 0x00, buf, len);
+	gpio_put(BS_FRAM_SS, 1);
+
+}
+
+static void fram_write_range_raw(uint32_t addr, const uint8_t *buf, int len) {
+
+	uint8_t cmdbuf[4];
+	int n = fram_cmd(cmdbuf, 0x02, addr);	// WRITE
+
+	fram_write_enable_raw(); // auto-disabled again when CS rises below
+
+	gpio_put(BS_FRAM_SS, 0);
+	spi_write_blocking(BS_FRAM_SPI, cmdbuf, n);
+	spi_write_blocking(BS_FRAM_SPI, buf, len);
+	gpio_put(BS_FRAM_SS, 1);
+
+}
+
+// RDID (0x9F): Fujitsu MB85RS parts answer with manufacturer 0x04,
+// continuation code 0x7F, then a product ID whose low 5 bits are the
+// density as log2 of the size in KB -- 0x03 for the 64Kbit (8KB)
+// MB85RS64, 0x08 for the 2Mbit (256KB) MB85RS2MT -- so bytes =
+// 1 << (10 + code).
+// Anything else (an older part without RDID answers all-0x00 or
+// all-0xFF, since nothing drives MISO) keeps the compile-time default
+// rather than guessing. Addressing follows from the size: the MB85RS
+// family switches to 3 address bytes above 64KB.
+static void fram_detect(void) {
+
+	uint8_t cmd = 0x9f;
+
+	gpio_put(BS_FRAM_SS, 0);
+	spi_write_blocking(BS_FRAM_SPI, &cmd, 1);
+	spi_read_blocking(BS_FRAM_SPI, 0x00, fram_id, sizeof(fram_id));
+	gpio_put(BS_FRAM_SS, 1);
+
+	if (fram_id[0] != 0x04 || fram_id[1] != 0x7f) return;
+
+	uint8_t code = fram_id[2] & 0x1f;
+	if (code < 1 || code > 14) return;	// 2KB .. 16MB, else not plausible
+
+	fram_bytes = 1u << (10 + code);
+	fram_addr3 = (fram_bytes > 65536);
+	fram_id_ok = true;
+
+	// the calibration ceiling, for the two parts the boards carry --
+	// any other density keeps the safe clock
+	if (code == 0x03) fram_rated_hz = FRAM_CLK_MB85RS64_HZ;
+	else if (code == 0x08) fram_rated_hz = FRAM_CLK_MB85RS2MT_HZ;
+
+}
+
+// SPI clock calibration. The board was always run at a fixed 10MHz,
+// well under what the parts themselves are rated for, but whether a
+// unit actually reaches that rating also depends on the board and the
+// RP2040's own RX sampling (its SPI block synchronises MISO through
+// two flops) -- so walk up the clocks the SPI block can actually
+// produce from clk_peri, never past the part's datasheet maximum
+// (fram_rated_hz), and keep the fastest one that proves reliable on
+// this particular unit. The probe only confirms a clock within the
+// rating works here; it could never make one beyond it safe.
+//
+// The probe uses the last FRAM_CAL_SCRATCH_LEN bytes of the chip --
+// the top of the FRAM_METADATA region, above anything LTSF stores, so
+// nothing of value is ever overwritten. A known pattern goes there
+// once at the safe clock; each faster candidate then has to read it
+// back exactly, several times, with plain READ or failing that FAST
+// READ (which some parts accept at a higher clock than READ, and
+// which a part without it simply never answers correctly -- so
+// support is discovered by the same test, not looked up). Reads are
+// proven before any write is attempted at a new clock: a write at a
+// clock the part can't follow could land anywhere. Only then does a
+// fresh pattern get written at the candidate clock and checked both
+// at that clock and back at the safe one, and the first candidate to
+// fail any of that ends the walk.
+#define FRAM_CAL_SCRATCH_LEN 16
+#define FRAM_CAL_READS 8
+
+static const uint32_t fram_cal_steps_hz[] = {
+	15000000, 20000000, 25000000, 30000000, 40000000,
+};
+
+static void fram_cal_pattern(uint8_t *p, int seed) {
+	for (int i = 0; i < FRAM_CAL_SCRATCH_LEN; i++)
+		p[i] = (uint8_t)((i & 1 ? 0xaa : 0x55) ^ (i * 0x1d) ^ seed);
+	p[0] = 0x00;	// every data line held low, then high
+	p[1] = 0xff;
+}
+
+static bool fram_cal_reads_back(const uint8_t *expect, bool fast) {
+	uint32_t addr = fram_bytes - FRAM_CAL_SCRATCH_LEN;
+	uint8_t got[FRAM_CAL_SCRATCH_LEN];
+	for (int r = 0; r < FRAM_CAL_READS; r++) {
+		memset(got, r & 1 ? 0x00 : 0xff, sizeof(got));
+		fram_read_raw(got, addr, sizeof(got), fast);
+		if (memcmp(got, expect, sizeof(got)) != 0) return false;
+	}
+	return true;
+}
+
+static void fram_calibrate(void) {
+
+	uint32_t addr = fram_bytes - FRAM_CAL_SCRATCH_LEN;
+	uint8_t pat[FRAM_CAL_SCRATCH_LEN];
+	int seed = 0;
+
+	fram_clk_hz = spi_set_baudrate(BS_FRAM_SPI, FRAM_CLK_SAFE_HZ);
+	fram_fast = false;
+	if (fram_rated_hz <= FRAM_CLK_SAFE_HZ) return;	// nothing to gain
+
+	fram_cal_pattern(pat, seed);
+	fram_write_range_raw(addr, pat, sizeof(pat));
+	if (!fram_cal_reads_back(pat, false)) return;	// not even the safe
+													// clock works -- no
+													// chip, or no point
+
+	for (unsigned s = 0; s < sizeof(fram_cal_steps_hz) / sizeof(fram_cal_steps_hz[0]); s++) {
+
+		if (fram_cal_steps_hz[s] > fram_rated_hz) break;
+
+		uint32_t hz = spi_set_baudrate(BS_FRAM_SPI, fram_cal_steps_hz[s]);
+		if (hz <= fram_clk_hz) continue;	// divider rounded down to a
+											// clock already proven
+
+		bool fast;
+		if (fram_cal_reads_back(pat, false)) fast = false;
+		else if (fram_cal_reads_back(pat, true)) fast = true;
+		else break;
+
+		uint8_t next[FRAM_CAL_SCRATCH_LEN];
+		fram_cal_pattern(next, ++seed);
+		fram_write_range_raw(addr, next, sizeof(next));
+		bool ok = fram_cal_reads_back(next, fast);
+
+		spi_set_baudrate(BS_FRAM_SPI, fram_clk_hz);
+		ok = ok && fram_cal_reads_back(next, fram_fast);
+		if (!ok) break;
+
+		memcpy(pat, next, sizeof(pat));
+		fram_clk_hz = hz;
+		fram_fast = fast;
+
+	}
+
+	spi_set_baudrate(BS_FRAM_SPI, fram_clk_hz);
+
+}
+
+uint32_t fram_clock_hz(void) {
+	return fram_clk_hz;
+}
+
+bool fram_fast_read(void) {
+	return fram_fast;
+}
+
+bool fram_valid_id(void) {
+	return fram_id_ok;
+}
+
+void fram_get_id(uint8_t id[4]) {
+	memcpy(id, fram_id, sizeof(fram_id));
+}
+
+uint32_t fram_size(void) {
+	return fram_bytes;
+}
+
+uint32_t fram_available(void) {
+	return fram_bytes - FRAM_METADATA;
+}
 
 void fram_init(void) {
 
+	mutex_init(&fram_bus);
+
 	gpio_init(BS_FRAM_SS);
 	gpio_init(BS_FRAM_MISO);
 	gpio_init(BS_FRAM_MOSI);
@@ -21,60 +383,236 @@ void fram_init(void) {
 	gpio_set_function(BS_FRAM_MOSI, GPIO_FUNC_SPI);
 	gpio_set_function(BS_FRAM_SCK, GPIO_FUNC_SPI);
 
+	// deselect before driving the pin: gpio_init() leaves the output
+	// latch at 0, which would otherwise hold CS low from here until the
+	// first transaction -- and RDID below needs a clean falling edge
+	// to be recognised as the start of a command
+	gpio_put(BS_FRAM_SS, 1);
 	gpio_set_dir(BS_FRAM_SS, 1);
 	gpio_set_dir(BS_FRAM_MOSI, 1);
 	gpio_set_dir(BS_FRAM_SCK, 1);
 
-	spi_init(BS_FRAM_SPI, 10000 * 1000);	// 10 MHz
+	spi_init(BS_FRAM_SPI, FRAM_CLK_SAFE_HZ);
+
+	fram_detect();	// at the safe clock, before anything depends on
+					// the size it finds
+	fram_calibrate();
+
+#if FRAM_MIRROR_SIZE > 0
+	if (fram_bytes <= FRAM_MIRROR_SIZE) {
+		fram_read_raw(fram_mirror, 0, fram_bytes, fram_fast);
+		mirror_on = true;
+	}
+#endif
+
+	dma_tx = dma_claim_unused_channel(true);
+	dma_rx = dma_claim_unused_channel(true);
 
 }
 
+bool fram_mirrored(void) {
+	return mirror_on;
+}
+
 void fram_read(char *buf, int addr, int len) {
 
-	int i;
-#ifdef FRAM_BIG
-	uint8_t cmdbuf[4] = { 0x03, addr >> 16, addr >> 8, addr & 0xff };	// READ
-#else
-	uint8_t cmdbuf[3] = { 0x03, addr >> 8, addr & 0xff };	// READ
+#if FRAM_MIRROR_SIZE > 0
+	if (mirror_on && len >= 0 && (uint32_t)addr < fram_bytes &&
+			(uint32_t)len <= fram_bytes - (uint32_t)addr) {
+		memcpy(buf, &fram_mirror[addr], len);
+		return;
+	}
 #endif
 
-	gpio_put(BS_FRAM_SS, 0);
-#ifdef FRAM_BIG
-	spi_write_blocking(BS_FRAM_SPI, cmdbuf, 4);
-#else
-	spi_write_blocking(BS_FRAM_SPI, cmdbuf, 3);
-#endif
-	spi_read_blocking(BS_FRAM_SPI, 0x00, buf, len);
-	gpio_put(BS_FRAM_SS, 1);
+	if (get_core_num() == 1) {
+
+		// pending write-behind bytes are overlaid rather than waited
+		// for. Snapshot the range first: core0 may write some of them
+		// out during the read, but only core1 (this core) ever adds
+		// to the queue or reuses its slots, so [t, h) stays valid.
+		uint32_t t = wb_tail;
+		uint32_t h = wb_head;
+
+		fram_dma_wait_idle();
+		mutex_enter_blocking(&fram_bus);
+		fram_read_raw((uint8_t *)buf, addr, len, fram_fast);
+		mutex_exit(&fram_bus);
+
+		for (; t != h; t++) {
+			uint32_t a = wb_addr[t % FRAM_WB_LEN];
+			if (a >= (uint32_t)addr && a - (uint32_t)addr < (uint32_t)len)
+				buf[a - addr] = (char)wb_data[t % FRAM_WB_LEN];
+		}
+		return;
+
+	}
+
+	fram_settle();
+	mutex_enter_blocking(&fram_bus);
+	fram_read_raw((uint8_t *)buf, addr, len, fram_fast);
+	mutex_exit(&fram_bus);
 
 }
 
 void fram_write_enable(void) {
 
-	uint8_t cmdbuf[1] = { 0x06 };
+	fram_settle();
+	mutex_enter_blocking(&fram_bus);
+	fram_write_enable_raw();
+	mutex_exit(&fram_bus);
+
+}
+
+void fram_write(int addr, unsigned char d) {
+
+	uint8_t cmdbuf[5];
+	int n = fram_cmd(cmdbuf, 0x02, addr);	// WRITE
+	cmdbuf[n++] = d;
+
+	mirror_update(addr, &d, 1);
+
+	fram_settle();
+	mutex_enter_blocking(&fram_bus);
+	fram_write_enable_raw(); // auto-disabled after each write
 
 	gpio_put(BS_FRAM_SS, 0);
-	spi_write_blocking(BS_FRAM_SPI, cmdbuf, 1); // WREN
+	spi_write_blocking(BS_FRAM_SPI, cmdbuf, n);
 	gpio_put(BS_FRAM_SS, 1);
+	mutex_exit(&fram_bus);
 
 }
 
-void fram_write(int addr, unsigned char d) {
+// burst write: one WREN, one WRITE opcode+address, then the whole
+// payload under a single chip-select assertion -- MB85RS parts
+// auto-increment the address internally for as long as CS stays low
+// (and have no page boundary to wrap at, unlike SPI flash), so this
+// is byte-for-byte identical to calling fram_write() len times, just
+// without paying a separate WREN + 4-byte frame + two CS toggles for
+// every single byte. Every bulk writer (buffer commit, LTSF metadata,
+// SRWP) goes through here; fram_write() stays for genuinely
+// single-byte callers.
+void fram_write_range(int addr, const unsigned char *buf, int len) {
 
-#ifdef FRAM_BIG
-	uint8_t cmdbuf[5] = { 0x02, addr >> 16, addr >> 8, addr & 0xff, d };	// WRITE
-#else
-	uint8_t cmdbuf[4] = { 0x02, addr >> 8, addr & 0xff, d };	// WRITE
-#endif
+	if (len <= 0) return;
+
+	mirror_update(addr, buf, len);
+
+	fram_settle();
+	mutex_enter_blocking(&fram_bus);
+	fram_write_range_raw(addr, buf, len);
+	mutex_exit(&fram_bus);
+
+}
+
+// asynchronous counterpart to fram_write_range(): queues the write on
+// fram_dma.c and returns its ticket. Goes through here rather than
+// straight to fram_dma_write() so the mirror picks the data up at
+// submit time -- reads served from it then see the new content
+// immediately, without waiting for the transfer to land. Same buffer
+// lifetime rule as fram_dma_write().
+uint32_t fram_write_async(int addr, const unsigned char *buf, int len) {
+	if (len < 0) len = 0;
+	mirror_update(addr, buf, len);
+	wb_flush();		// older queued keystrokes land first
+	return fram_dma_write(buf, addr, len, NULL, NULL);
+}
+
+// core1's immediate-mode single-byte write: queued for core0 (see the
+// write-behind queue above) rather than written here. Blocks only if
+// the queue is full, until core0 has made room. Waits for any DMA
+// transfers still queued first -- core0 could otherwise slip this byte
+// in between two of them, ahead of an older write to the same place.
+// From core0 it's just fram_write().
+void fram_write_behind(int addr, unsigned char d) {
+
+	if (get_core_num() != 1) {
+		fram_write(addr, d);
+		return;
+	}
+
+	mirror_update(addr, &d, 1);
+	if (!fram_dma_idle()) fram_dma_wait_idle();
+
+	uint32_t h = wb_head;
+	while (h - wb_tail >= FRAM_WB_LEN) tight_loop_contents();
+
+	wb_addr[h % FRAM_WB_LEN] = (uint32_t)addr;
+	wb_data[h % FRAM_WB_LEN] = d;
+	__mem_fence_release();	// entry visible before the new head
+	wb_head = h + 1;
+
+}
 
-	fram_write_enable(); // auto-disabled after each write
+// core0, once per main-loop pass: writes out a bounded amount of the
+// write-behind queue, so a long paste can't hold up USB servicing
+void fram_write_behind_drain(void) {
+	for (int i = 0; i < 4 && wb_drain_run(); i++) ;
+}
+
+// durability barrier: returns once every write issued so far --
+// write-behind and asynchronous alike -- is on the chip
+void fram_flush(void) {
+	fram_settle();
+}
+
+// ---- fram_dma.c port layer ----
+
+// same framing as fram_read()/fram_write_range() above -- WREN (for a
+// write), CS low, opcode + address sent the ordinary blocking way
+// (3-4 bytes, not worth a DMA setup), and then only the payload is
+// handed to the DMA. spi_write_blocking() drains the RX FIFO before
+// returning, so the RX channel starts from a clean FIFO and its byte
+// count matches the TX channel's exactly.
+void fram_dma_port_start(const fram_dma_desc_t *d) {
+
+	bool wr = (d->op == FRAM_DMA_WRITE);
+	uint8_t cmdbuf[5];
+	int n = wr ? fram_cmd(cmdbuf, 0x02, d->addr)	// WRITE
+		: fram_read_cmd(cmdbuf, d->addr, fram_fast);	// READ / FAST READ
+
+	mutex_enter_blocking(&fram_bus);	// held until port_finish()
+
+	if (wr) fram_write_enable_raw();
 
 	gpio_put(BS_FRAM_SS, 0);
-#ifdef FRAM_BIG
-	spi_write_blocking(BS_FRAM_SPI, cmdbuf, 5);
-#else
-	spi_write_blocking(BS_FRAM_SPI, cmdbuf, 4);
-#endif
-	gpio_put(BS_FRAM_SS, 1);
+	spi_write_blocking(BS_FRAM_SPI, cmdbuf, n);
+
+	io_rw_32 *dr = &spi_get_hw(BS_FRAM_SPI)->dr;
+
+	dma_channel_config c = dma_channel_get_default_config(dma_tx);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_dreq(&c, spi_get_dreq(BS_FRAM_SPI, true));
+	channel_config_set_read_increment(&c, wr);
+	channel_config_set_write_increment(&c, false);
+	dma_channel_configure(dma_tx, &c, dr,
+		wr ? (const void *)d->buf : (const void *)&dma_tx_zero,
+		d->len, false);
+
+	c = dma_channel_get_default_config(dma_rx);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_dreq(&c, spi_get_dreq(BS_FRAM_SPI, false));
+	channel_config_set_read_increment(&c, false);
+	channel_config_set_write_increment(&c, !wr);
+	dma_channel_configure(dma_rx, &c,
+		wr ? (void *)&dma_rx_sink : (void *)d->buf, dr,
+		d->len, false);
+
+	// both at once, so the RX channel is already armed by the time the
+	// first byte comes back
+	dma_start_channel_mask((1u << dma_tx) | (1u << dma_rx));
+
+}
+
+// the RX side finishes last -- once it has collected len bytes, every
+// byte has been fully clocked through the chip, write or read
+bool fram_dma_port_busy(void) {
+	return dma_channel_is_busy(dma_rx);
+}
+
+void fram_dma_port_finish(void) {
+
+	while (spi_is_busy(BS_FRAM_SPI)) tight_loop_contents();
+	gpio_put(BS_FRAM_SS, 1);	// also ends (and write-protects) a WRITE
+	mutex_exit(&fram_bus);
 
 }
@@ -1,8 +1,37 @@
 #include <stdbool.h>
+#include <stdint.h>
 
 void fram_init(void);
 void fram_read(char *buf, int addr, int len);
 void fram_write_enable(void);
 void fram_write(int addr, unsigned char d);
-bool fram_valid_id(void);
+void fram_write_range(int addr, const unsigned char *buf, int len);
+uint32_t fram_write_async(int addr, const unsigned char *buf, int len);
+
+// immediate-mode writes from core1, queued and written out by core0
+// between USB passes (fram_write_behind_drain(), from core0's main
+// loop) -- reads see them straight away. fram_flush() waits until
+// everything written so far, queued or asynchronous, is on the chip.
+void fram_write_behind(int addr, unsigned char d);
+void fram_write_behind_drain(void);
+void fram_flush(void);
 unsigned char spi_xfer(unsigned char d);
+
+// geometry, detected by fram_init() via RDID (falls back to the
+// compile-time FRAM_SIZE if the part doesn't identify itself --
+// fram_valid_id() says which). fram_available() is what storage.c
+// exposes as the FRAM file: everything below the FRAM_METADATA bytes
+// reserved at the top of the chip for LTSF.
+bool fram_valid_id(void);
+void fram_get_id(uint8_t id[4]);
+uint32_t fram_size(void);
+uint32_t fram_available(void);
+
+// SPI clock and read opcode picked by the boot-time calibration in
+// fram_init() -- for display (`info`).
+uint32_t fram_clock_hz(void);
+bool fram_fast_read(void);
+
+// true when fram_read() is being served from the RAM mirror (the part
+// fits FRAM_MIRROR_SIZE) rather than the chip.
+bool fram_mirrored(void);
@@ -0,0 +1,116 @@
+/*
+ * Asynchronous FRAM transfer queue -- see fram_dma.h for the contract.
+ *
+ * A plain ring of descriptors plus one "in flight" flag. Only core1
+ * ever touches this (storage.c, SRWP and the editors all run there,
+ * and core0's vendor-command path goes through the blocking fram.c
+ * entry points, which drain this queue first), and completion is
+ * discovered by polling rather than by a DMA interrupt, so there is
+ * no locking here at all -- nothing can ever run concurrently with
+ * any of these functions.
+ */
+
+#include <stddef.h>
+
+#include "fram_dma.h"
+
+static fram_dma_desc_t queue[FRAM_DMA_QUEUE_LEN];
+static int q_head = 0;		// next descriptor to start
+static int q_count = 0;		// queued, including the one in flight
+static bool in_flight = false;
+
+// tickets: submitted counts every submit ever made, completed every
+// transfer ever retired. Transfers retire strictly in submit order, so
+// "ticket t is done" is simply completed >= t. uint32_t wraps after
+// 4 billion transfers -- compared by signed difference below so even
+// that would be harmless.
+static uint32_t submitted = 0;
+static uint32_t completed = 0;
+
+static void start_head(void) {
+	if (in_flight || q_count == 0) return;
+	in_flight = true;
+	if (queue[q_head].len == 0) return;	// retired by the next poll
+										// without touching the bus
+	fram_dma_port_start(&queue[q_head]);
+}
+
+static uint32_t submit(fram_dma_op_t op, uint8_t *buf, uint32_t addr,
+	uint32_t len, fram_dma_cb_t cb, void *ctx) {
+
+	while (q_count == FRAM_DMA_QUEUE_LEN)
+		fram_dma_poll();
+
+	int slot = (q_head + q_count) % FRAM_DMA_QUEUE_LEN;
+	queue[slot].op = op;
+	queue[slot].addr = addr;
+	queue[slot].buf = buf;
+	queue[slot].len = len;
+	queue[slot].cb = cb;
+	queue[slot].ctx = ctx;
+	q_count++;
+
+	// kick it off right away if the bus was idle, rather than waiting
+	// for the next poll -- otherwise a lone commit would sit doing
+	// nothing until editor_yield() came back around
+	start_head();
+
+	return ++submitted;
+}
+
+uint32_t fram_dma_read(uint8_t *buf, uint32_t addr, uint32_t len,
+	fram_dma_cb_t cb, void *ctx) {
+	return submit(FRAM_DMA_READ, buf, addr, len, cb, ctx);
+}
+
+uint32_t fram_dma_write(const uint8_t *buf, uint32_t addr, uint32_t len,
+	fram_dma_cb_t cb, void *ctx) {
+	return submit(FRAM_DMA_WRITE, (uint8_t *)buf, addr, len, cb, ctx);
+}
+
+bool fram_dma_poll(void) {
+
+	if (!in_flight) return false;
+
+	fram_dma_desc_t *d = &queue[q_head];
+	if (d->len > 0) {
+		if (fram_dma_port_busy()) return true;
+		fram_dma_port_finish();
+	}
+
+	// copy out before releasing the slot: the callback may well submit
+	// a follow-up transfer into it
+	fram_dma_cb_t cb = d->cb;
+	void *ctx = d->ctx;
+
+	q_head = (q_head + 1) % FRAM_DMA_QUEUE_LEN;
+	q_count--;
+	in_flight = false;
+	completed++;
+
+	// start the next one before running the callback, so the bus isn't
+	// left idle for however long the callback takes
+	start_head();
+
+	if (cb) cb(ctx);
+
+	return in_flight;
+}
+
+bool fram_dma_done(uint32_t ticket) {
+	return (int32_t)(completed - ticket) >= 0;
+}
+
+void fram_dma_wait(uint32_t ticket) {
+	while (!fram_dma_done(ticket))
+		fram_dma_poll();
+}
+
+bool fram_dma_idle(void) {
+	return q_count == 0;
+}
+
+void fram_dma_wait_idle(void) {
+	while (!fram_dma_idle())
+		fram_dma_poll();
+}
@@ -0,0 +1,92 @@
+#ifndef FRAM_DMA_H_
+#define FRAM_DMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Asynchronous FRAM transfer queue. Reads and writes are queued as
+ * descriptors and moved over BS_FRAM_SPI by DMA one at a time, in
+ * submission order, so core1 can keep running the UI (or crypto)
+ * while a 7.5KB commit streams out, instead of busy-waiting inside
+ * spi_write_blocking() for every byte.
+ *
+ * Completion is reported two ways, both optional: an optional
+ * callback (run from inside fram_dma_poll(), in core1 context -- NOT
+ * from an interrupt, so it may safely touch anything core1 already
+ * owns), and a poll flag in the form of a ticket: every submit returns
+ * a monotonically increasing ticket, and fram_dma_done(ticket) is true
+ * once that transfer (and therefore everything queued before it) has
+ * fully landed. Nothing advances unless fram_dma_poll() is called --
+ * editor_yield() does that once per pass, and every blocking entry
+ * point in fram.c drains the queue first, so fram_read()/fram_write()
+ * callers always see a fully-settled chip without knowing this queue
+ * exists.
+ *
+ * Buffers passed to a submit must stay valid until that ticket is
+ * done -- the DMA reads from / writes into them directly, with no
+ * copy.
+ *
+ * This file deliberately contains no pico-sdk calls at all: the
+ * hardware side lives behind the three fram_dma_port_*() functions
+ * below, implemented in fram.c on the device and by a simulated DMA
+ * channel in tools/test_fram_dma.c on a desktop, so the queueing
+ * logic itself can be tested and benchmarked without hardware.
+ */
+
+#define FRAM_DMA_QUEUE_LEN 8	// descriptors, not bytes -- a full
+								// 7.5KB commit is one descriptor
+
+typedef enum {
+	FRAM_DMA_READ = 0,
+	FRAM_DMA_WRITE = 1,
+} fram_dma_op_t;
+
+typedef void (*fram_dma_cb_t)(void *ctx);
+
+typedef struct {
+	fram_dma_op_t op;
+	uint32_t addr;
+	uint8_t *buf;			// const for writes, in spirit -- never
+							// written through for FRAM_DMA_WRITE
+	uint32_t len;
+	fram_dma_cb_t cb;		// may be NULL
+	void *ctx;
+} fram_dma_desc_t;
+
+// queue a transfer. Never fails: if the queue is already full, polls
+// until a slot frees up (i.e. degrades to blocking rather than
+// dropping anything). Returns the ticket for fram_dma_done()/
+// fram_dma_wait(). A zero-length request completes immediately (its
+// callback, if any, still runs, from the next poll).
+uint32_t fram_dma_read(uint8_t *buf, uint32_t addr, uint32_t len,
+	fram_dma_cb_t cb, void *ctx);
+uint32_t fram_dma_write(const uint8_t *buf, uint32_t addr, uint32_t len,
+	fram_dma_cb_t cb, void *ctx);
+
+// retires a finished transfer (raising CS, running its callback) and
+// starts the next queued one, if any. Cheap when there's nothing to
+// do. Returns true while anything is still queued or in flight.
+bool fram_dma_poll(void);
+
+bool fram_dma_done(uint32_t ticket);
+void fram_dma_wait(uint32_t ticket);
+bool fram_dma_idle(void);
+void fram_dma_wait_idle(void);
+
+// ---- port layer -- implemented by the platform, called only by
+// fram_dma.c itself ----
+
+// asserts CS, sends the opcode/address header (and WREN first, for a
+// write), then starts the payload DMA for `d` and returns immediately.
+void fram_dma_port_start(const fram_dma_desc_t *d);
+
+// true while the payload DMA for the transfer last started is still
+// running.
+bool fram_dma_port_busy(void);
+
+// called once fram_dma_port_busy() has gone false: waits out the
+// last byte still shifting out of the SPI block, then releases CS.
+void fram_dma_port_finish(void);
+
+#endif
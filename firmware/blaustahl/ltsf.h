@@ -3,7 +3,7 @@
  * Copyright (c) 2024 Lone Dynamics Corporation. All rights reserved.
  *
  * This metadata is located in FRAM immediately after the content
- * region (offset FRAM_AVAILABLE, 128 bytes). Ported from the
+ * region (offset fram_available(), 128 bytes). Ported from the
  * machdyne/blaustahl feature/encryption branch -- byte layout must
  * stay exactly as documented in ltsf_pack()/ltsf_unpack() in
  * storage.c, which is NOT simply this struct's memory layout (the
@@ -22,22 +22,56 @@
 #define LTSF_ALGO_SHA256_CHACHA20_POLY1305 1
 
 #define LTSF_META_SIZE 128		// reserved region size in FRAM
-#define LTSF_PACKED_SIZE 100	// actual bytes used by ltsf_pack()
+#define LTSF_PACKED_SIZE 103	// actual bytes used by ltsf_pack()
+
+// v0: the whole content region is one ChaCha20-Poly1305 message, its
+// nonce/tag in the header. v1: the content region is split into
+// independently authenticated sectors, each with its own counter and
+// tag in a table right after the header (below), so a commit only
+// re-encrypts the sectors it touched and reads decrypt one sector at
+// a time. v0 is still read, and migrated to v1 on first unlock.
+#define LTSF_VERSION_WHOLE 0
+#define LTSF_VERSION_SECTORED 1
+
+// v1 sector table: LTSF_SECTOR_REC_SIZE bytes per sector (counter:u32
+// LE, then the 16-byte tag), starting LTSF_SECTOR_REC_OFFSET bytes
+// into the metadata region. LTSF_MAX_SECTORS records end at byte 488
+// of the 512-byte FRAM_METADATA region, leaving its top 16 bytes to
+// fram.c's clock calibration probe. Sector size is therefore a
+// function of the chip: the smallest multiple of LTSF_SECTOR_UNIT that
+// covers the content region in LTSF_MAX_SECTORS sectors or fewer --
+// 512 bytes (15 sectors) on an 8KB part.
+#define LTSF_SECTOR_REC_OFFSET 128
+#define LTSF_SECTOR_REC_SIZE 20
+#define LTSF_MAX_SECTORS 18
+#define LTSF_SECTOR_UNIT 512
 
 typedef struct ltsf_meta_t {
 
 	uint16_t	magic;			// indicates LTSF metadata is present
-	uint8_t		version;		// LTSF version (0x00)
+	uint8_t		version;		// LTSF version (0x00 or 0x01)
 	uint8_t		algo;			// LTSF encryption algorithm:
 								//  0x00 none / plaintext
 								//  0x01 SHA256 KDF + ChaCha20-Poly1305
 	uint8_t		plaindesc[48];	// describes content or encryption algorithm
 								// (always cleartext, even when algo != 0)
 	uint8_t		salt[16];		// salt used by KDF
-	uint8_t		nonce[12];		// nonce used by encryption algo
-	uint8_t		tag[16];		// AEAD authentication tag
+	uint8_t		nonce[12];		// v0: nonce used by encryption algo
+	uint8_t		tag[16];		// v0: AEAD authentication tag
+	uint16_t	sector_units;	// v1: sector size, in LTSF_SECTOR_UNITs
+	uint8_t		sector_count;	// v1: number of sectors
 	uint32_t	bootctr;		// boot counter (informational only)
 
 } ltsf_meta_t;
 
+// one v1 sector table record
+typedef struct ltsf_sector_t {
+
+	uint32_t	counter;		// bumped on every re-encryption of this
+								// sector -- with the sector index, makes
+								// up its nonce
+	uint8_t		tag[16];		// AEAD authentication tag
+
+} ltsf_sector_t;
+
 #endif
@@ -13,10 +13,11 @@
  * marker -- it never reads the marker itself.
  *
  * Deliberately encryption-unaware, by design: this operates on the
- * full, raw 8KB FRAM chip (all of it, not just the encrypted
- * firmware's usable content region), completely bypassing storage.c's
- * buffer mode and any encryption layered on top of it. A read returns
- * whatever is physically on the chip -- ciphertext, if FRAM happens to
+ * full, raw FRAM chip (all of it -- 8KB or 256KB, whatever fram_init()
+ * detected -- not just the encrypted firmware's usable content
+ * region), completely bypassing storage.c's buffer mode and any
+ * encryption layered on top of it. A read returns whatever is
+ * physically on the chip -- ciphertext, if FRAM happens to
  * be encrypted -- and a write goes straight to the chip. If FRAM is
  * encrypted, writing through SRWP will corrupt it beyond recovery
  * (the AEAD tag stops matching), exactly as writing garbage over any
@@ -42,7 +43,7 @@
  *    SRWP_CHUNK_SIZE buffer instead, regardless of how large the
  *    requested length is.
  *
- * 2. Bounds-checked against the full physical FRAM size (8192 bytes),
+ * 2. Bounds-checked against the full physical FRAM size (fram_size()),
  *    with overflow-safe arithmetic (addr+len is never computed
  *    directly and compared, which could wrap past UINT32_MAX and
  *    incorrectly pass). Since the protocol itself has no error
@@ -57,14 +58,15 @@
  *    single tud_cdc_read(buf, 4) call and gave up immediately (silently
  *    losing any bytes already read) if fewer than 4 arrived in that one
  *    call -- a real desync risk under ordinary USB packet
- *    fragmentation. Every multi-byte value here accumulates through a
- *    proper byte-at-a-time loop with a bounded per-byte timeout
- *    instead (srwp_read_bytes()), the same "block with a timeout, not
- *    a busy-fail on any gap" philosophy already established by
- *    xmodem.c's xmodem_getchar_timeout() elsewhere in this firmware.
- *    Once the leading 0x00 has committed the host to a command, it's
- *    correct to wait a reasonable bounded time for the rest of it
- *    rather than abandon the parse on the first timing hiccup.
+ *    fragmentation. Every read here accumulates until it has all the
+ *    bytes it asked for, with a bounded timeout on each gap in the
+ *    stream instead (cdc_read_block()), the same "block with a
+ *    timeout, not a busy-fail on any gap" philosophy already
+ *    established by xmodem.c's xmodem_getchar_timeout() elsewhere in
+ *    this firmware. Once the leading 0x00 has committed the host to a
+ *    command, it's correct to wait a reasonable bounded time for the
+ *    rest of it rather than abandon the parse on the first timing
+ *    hiccup.
  *
  * 4. Portable, explicit little-endian decoding. The original read
  *    raw bytes directly into a uint32_t via a pointer cast
@@ -73,18 +75,53 @@
  *    work on this specific little-endian target but is fragile and
  *    non-obvious. srwp_read_u32()/srwp_write_u32() assemble/emit the
  *    four bytes explicitly instead.
+ *
+ * 5. Block I/O. Payloads move as many bytes per TinyUSB call as the
+ *    FIFOs allow: tud_cdc_read() straight into the destination for
+ *    whatever has arrived, tud_cdc_write() of as much as there's room
+ *    for (waiting, bounded, when there's none), and one flush per
+ *    reply. The original pushed every byte through its own
+ *    tud_cdc_write_char() and read every byte through cdc_getchar()
+ *    with its own deadline check, so a full-chip dump was bounded by
+ *    per-byte call overhead rather than by USB.
+ *
+ * SRWP v2 (firmware-specific, negotiated with CMD_HELLO): v1 has no
+ * way to report an error, no check on what arrived, and handles one
+ * command per leading 0x00, so a host can't send the next command
+ * until the last one's reply is in. After a successful HELLO, srwp()
+ * stays in srwp_session() instead, reading frames -- a start byte,
+ * sequence number, command, payload length, payload and CRC-32 --
+ * and answering each with a frame carrying a status code. The host
+ * may have up to the negotiated window of requests outstanding at
+ * once. The payloads are the v1 command bodies, run by the same
+ * cmd_*() handlers, reading from the frame and replying into a frame
+ * buffer instead of straight to CDC; bounds, zero padding and every
+ * other v1 rule apply unchanged. The session ends on CMD_BYE or after
+ * SRWP_SESSION_IDLE_MS without a frame, back to v1 and the UI.
+ *
+ * Flash files (CMD_FILE_*): the one place SRWP isn't raw FRAM. List,
+ * stat, ranged reads, a streaming write, rename and delete, straight
+ * onto flash_storage.h -- the same calls XMODEM and the browser use,
+ * so a provisioning script can move files without a terminal program
+ * in the loop. Same rules as the rest: data streams through
+ * chunk_buf (or, for reads, straight out of memory-mapped flash), and
+ * every body is read in full, even one that's rejected.
  */
 
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "pico/time.h"
 #include "tusb.h"
+#include "lfs_util.h"
 
 #include "blaustahl.h"
 #include "editor.h"
 #include "fram.h"
+#include "crypt.h"
+#include "flash_storage.h"
 #include "srwp.h"
 
 #define CMD_TEST  0x00
@@ -93,12 +130,43 @@
 #define CMD_SIZE  0x0a		// firmware-specific extension, not part of
 							// the documented upstream protocol -- see
 							// docs/srwp.md
+#define CMD_CRC32    0x0b	// firmware-specific extensions too: digests
+#define CMD_SHA256   0x0c	// of a range, and of every block, so a host
+#define CMD_MANIFEST 0x0d	// can tell what changed without reading it
+#define CMD_HELLO    0x0e	// v1 only: negotiates v2 framing
+#define CMD_BYE      0x0f	// v2 only: ends the session
+#define CMD_READV    0x10	// firmware-specific: several ranges read or
+#define CMD_WRITEV   0x11	// written in one exchange
 
-#define SRWP_FRAM_SIZE 8192	// full physical chip capacity -- deliberately
-							// NOT FRAM_AVAILABLE (the smaller,
-							// metadata-excluded region storage.c uses):
-							// SRWP is raw and encryption-unaware by
-							// design, see file header
+// flash files -- see the file header and docs/srwp.md
+#define CMD_FILE_LIST   0x20
+#define CMD_FILE_STAT   0x21
+#define CMD_FILE_READ   0x22
+#define CMD_FILE_CREATE 0x23
+#define CMD_FILE_APPEND 0x24
+#define CMD_FILE_CLOSE  0x25
+#define CMD_FILE_RENAME 0x26
+#define CMD_FILE_DELETE 0x27
+
+// v2 reply status codes. The handlers return these in v1 too, where
+// they're just not sent anywhere.
+#define SRWP_OK			0x00
+#define SRWP_RANGE		0x01	// done, but part of the range was past
+								// the chip (zero padded / not written)
+#define SRWP_MALFORMED	0x02	// body doesn't fit the command
+#define SRWP_UNKNOWN	0x03	// no such command
+#define SRWP_TOO_LONG	0x04	// reply wouldn't fit in one frame
+#define SRWP_FAILED		0x05	// couldn't be carried out (hashing)
+#define SRWP_BAD_FRAME	0x06	// NAK: bad CRC or length -- seq is the
+#define SRWP_BAD_SEQ	0x07	// NAK: out of order    -- one expected
+#define SRWP_NOT_FOUND	0x08	// no such flash file
+
+#define SRWP_FRAM_SIZE (fram_size())	// full physical chip capacity, as
+									// detected at boot -- deliberately
+									// NOT fram_available() (the smaller,
+									// metadata-excluded region storage.c
+									// uses): SRWP is raw and encryption-
+									// unaware by design, see file header
 
 // once a command has started (the leading 0x00 marker was already
 // consumed by the caller), it's reasonable to wait a bounded time per
@@ -114,62 +182,157 @@
 #define SRWP_CHUNK_SIZE 128
 static uint8_t chunk_buf[SRWP_CHUNK_SIZE];
 
-static int srwp_getchar_timeout(uint32_t timeout_ms) {
+// ---- v2 session parameters ----
+
+#define SRWP_VERSION 2
+#define SRWP_SOF 0xa5
+
+// largest frame payload either way (-DSRWP_FRAME_MAX=N, at most 65535
+// to fit the length field). A request is held whole until its CRC has
+// been checked, so nothing is written from a corrupted frame, and a
+// reply is built whole so its length can lead it -- one buffer each.
+#ifndef SRWP_FRAME_MAX
+#define SRWP_FRAME_MAX 1024
+#endif
+
+// most requests a host may send ahead of their replies
+// (-DSRWP_WINDOW=N). The device answers strictly in order either way;
+// this bounds how many reply frames can be queued up on the host's
+// side of the link.
+#ifndef SRWP_WINDOW
+#define SRWP_WINDOW 8
+#endif
+
+// a session with no frame for this long ends on its own, back to v1
+// and the UI -- a host that went away mid-session doesn't leave the
+// device stuck in v2
+#define SRWP_SESSION_IDLE_MS 1000
+
+// after a bad frame, input is dropped until the line has been quiet
+// this long, so whatever else the host had in flight is discarded
+// with it rather than parsed from the middle
+#define SRWP_PURGE_MS 50
+
+// while a v2 frame runs, srwp_read_bytes() takes the command body from
+// its payload and srwp_write_bytes() collects the reply in reply_buf
+static bool in_frame = false;
+static const uint8_t *body;
+static uint32_t body_left;
+static uint8_t req_buf[SRWP_FRAME_MAX];
+static uint8_t reply_buf[SRWP_FRAME_MAX];
+static uint32_t reply_len;
+
+// accumulates exactly `len` bytes, taking whatever the RX FIFO holds
+// in one tud_cdc_read() at a time, unlike the original single-shot
+// reads this replaces -- see hardening notes 3 and 5 above. The
+// timeout restarts whenever anything arrives, so it bounds each gap
+// in the stream, not the whole transfer.
+static bool cdc_read_block(uint8_t *buf, uint32_t len) {
 
-	absolute_time_t deadline = make_timeout_time_ms(timeout_ms);
+	absolute_time_t deadline = make_timeout_time_ms(SRWP_BYTE_TIMEOUT_MS);
+	uint32_t got = 0;
 
-	while (!time_reached(deadline)) {
-		int c = cdc_getchar();
-		if (c != -1) return c;
+	while (got < len) {
+		uint32_t n = 0;
+		if (tud_cdc_connected() && tud_cdc_available())
+			n = tud_cdc_read(&buf[got], len - got);
+		if (n) {
+			got += n;
+			deadline = make_timeout_time_ms(SRWP_BYTE_TIMEOUT_MS);
+		} else if (time_reached(deadline)) {
+			return false;
+		}
 	}
 
-	return -1;
+	return true;
 
 }
 
-// accumulates exactly `len` bytes with a per-byte timeout, unlike the
-// original single-shot tud_cdc_read() calls this replaces -- see
-// hardening note 3 above.
-static bool srwp_read_bytes(uint8_t *buf, uint32_t len) {
+// explicit little-endian assembly -- see hardening note 4 above
+static uint32_t get_le32(const uint8_t *b) {
+	return (uint32_t)b[0]
+		| ((uint32_t)b[1] << 8)
+		| ((uint32_t)b[2] << 16)
+		| ((uint32_t)b[3] << 24);
+}
+
+static void put_le32(uint8_t *b, uint32_t v) {
+	b[0] = (uint8_t)(v & 0xff);
+	b[1] = (uint8_t)((v >> 8) & 0xff);
+	b[2] = (uint8_t)((v >> 16) & 0xff);
+	b[3] = (uint8_t)((v >> 24) & 0xff);
+}
+
+// queues `len` bytes for the host in as few tud_cdc_write() calls as
+// the TX FIFO's free space allows -- TinyUSB sends each full packet
+// as it fills, and srwp() flushes the last, partial one once the
+// whole reply is queued. With the FIFO full, it waits for the host to
+// drain it, with the same per-gap timeout as cdc_read_block() (like
+// cdc_putchar_reliable(), never dropping a byte for lack of room).
+// False if the host stopped reading.
+static bool cdc_write_block(const uint8_t *buf, uint32_t len) {
+
+	absolute_time_t deadline = make_timeout_time_ms(SRWP_BYTE_TIMEOUT_MS);
+	uint32_t sent = 0;
 
-	for (uint32_t i = 0; i < len; i++) {
-		int c = srwp_getchar_timeout(SRWP_BYTE_TIMEOUT_MS);
-		if (c < 0) return false;
-		buf[i] = (uint8_t)c;
+	while (sent < len) {
+		if (!tud_cdc_connected()) return false;
+		uint32_t room = tud_cdc_write_available();
+		if (room) {
+			uint32_t n = len - sent < room ? len - sent : room;
+			sent += tud_cdc_write(&buf[sent], n);
+			deadline = make_timeout_time_ms(SRWP_BYTE_TIMEOUT_MS);
+		} else {
+			tud_cdc_write_flush();	// a partial packet may be all that's queued
+			if (time_reached(deadline)) return false;
+		}
 	}
 
 	return true;
 
 }
 
+// a command body, from CDC in v1 or the current frame's payload in
+// v2. False if it ran short -- a timeout in v1, a payload too small
+// for what the command asked for in v2.
+static bool srwp_read_bytes(uint8_t *buf, uint32_t len) {
+
+	if (!in_frame) return cdc_read_block(buf, len);
+
+	if (len > body_left) return false;
+	memcpy(buf, body, len);
+	body += len;
+	body_left -= len;
+	return true;
+
+}
+
 static bool srwp_read_u32(uint32_t *out) {
 
 	uint8_t b[4];
 	if (!srwp_read_bytes(b, 4)) return false;
-
-	// explicit little-endian assembly -- see hardening note 4 above
-	*out = (uint32_t)b[0]
-		| ((uint32_t)b[1] << 8)
-		| ((uint32_t)b[2] << 16)
-		| ((uint32_t)b[3] << 24);
-
+	*out = get_le32(b);
 	return true;
 
 }
 
-static void srwp_write_bytes(const uint8_t *buf, uint32_t len) {
-	for (uint32_t i = 0; i < len; i++) tud_cdc_write_char(buf[i]);
-	tud_cdc_write_flush();
+// a command's reply, straight to CDC in v1 or into reply_buf in v2.
+// False if the host stopped reading, or the reply outgrew a frame.
+static bool srwp_write_bytes(const uint8_t *buf, uint32_t len) {
+
+	if (!in_frame) return cdc_write_block(buf, len);
+
+	if (len > SRWP_FRAME_MAX - reply_len) return false;
+	memcpy(&reply_buf[reply_len], buf, len);
+	reply_len += len;
+	return true;
+
 }
 
-static void srwp_write_u32(uint32_t v) {
-	uint8_t b[4] = {
-		(uint8_t)(v & 0xff),
-		(uint8_t)((v >> 8) & 0xff),
-		(uint8_t)((v >> 16) & 0xff),
-		(uint8_t)((v >> 24) & 0xff),
-	};
-	srwp_write_bytes(b, 4);
+static bool srwp_write_u32(uint32_t v) {
+	uint8_t b[4];
+	put_le32(b, v);
+	return srwp_write_bytes(b, 4);
 }
 
 // CMD_TEST: echo `len` bytes back exactly as received. No FRAM
@@ -177,21 +340,28 @@ static void srwp_write_u32(uint32_t v) {
 // large enough to be clearly unreasonable -- capped at the chip's own
 // capacity as a sanity bound, streamed through the fixed chunk buffer
 // regardless of size either way.
-static void cmd_test(void) {
+//
+// Every handler returns a v2 status code: SRWP_MALFORMED if the body
+// ran short or asked for something absurd, SRWP_TOO_LONG if the reply
+// couldn't be sent (which in v2 means it outgrew the frame).
+static uint8_t cmd_test(void) {
 
 	uint32_t len;
-	if (!srwp_read_u32(&len)) return;
-	if (len > SRWP_FRAM_SIZE) return;	// clearly malformed -- abort,
-										// don't attempt to drain or reply
+	if (!srwp_read_u32(&len)) return SRWP_MALFORMED;
+	if (len > SRWP_FRAM_SIZE) return SRWP_MALFORMED;	// clearly malformed --
+														// abort, don't attempt
+														// to drain or reply
 
 	uint32_t remaining = len;
 	while (remaining > 0) {
 		uint32_t chunk = remaining < SRWP_CHUNK_SIZE ? remaining : SRWP_CHUNK_SIZE;
-		if (!srwp_read_bytes(chunk_buf, chunk)) return;
-		srwp_write_bytes(chunk_buf, chunk);
+		if (!srwp_read_bytes(chunk_buf, chunk)) return SRWP_MALFORMED;
+		if (!srwp_write_bytes(chunk_buf, chunk)) return SRWP_TOO_LONG;
 		remaining -= chunk;
 	}
 
+	return SRWP_OK;
+
 }
 
 // CMD_READ: always replies with exactly `len` bytes, even if the
@@ -199,13 +369,11 @@ static void cmd_test(void) {
 // zero-padded rather than the reply being short, since the protocol
 // has no way to signal "here's less than you asked for" and a host
 // waiting on a fixed-length reply that never fully arrives would just
-// hang.
-static void cmd_read(void) {
-
-	uint32_t addr, len;
-	if (!srwp_read_u32(&addr)) return;
-	if (!srwp_read_u32(&len)) return;
-	if (len > SRWP_FRAM_SIZE) return;	// clearly malformed -- abort
+// hang. (v2 can say so: SRWP_RANGE, padding still included.)
+//
+// read_range() is the part after the body's been parsed, shared with
+// CMD_READV; cmd_read() does the parsing.
+static uint8_t read_range(uint32_t addr, uint32_t len) {
 
 	uint32_t valid_len = 0;
 	if (addr < SRWP_FRAM_SIZE) {
@@ -219,7 +387,7 @@ static void cmd_read(void) {
 		uint32_t chunk = valid_len - offset;
 		if (chunk > SRWP_CHUNK_SIZE) chunk = SRWP_CHUNK_SIZE;
 		fram_read((char *)chunk_buf, (int)(addr + offset), (int)chunk);
-		srwp_write_bytes(chunk_buf, chunk);
+		if (!srwp_write_bytes(chunk_buf, chunk)) return SRWP_TOO_LONG;
 		offset += chunk;
 	}
 
@@ -232,12 +400,27 @@ static void cmd_read(void) {
 
 		while (pad > 0) {
 			uint32_t chunk = pad < SRWP_CHUNK_SIZE ? pad : SRWP_CHUNK_SIZE;
-			srwp_write_bytes(chunk_buf, chunk);
+			if (!srwp_write_bytes(chunk_buf, chunk)) return SRWP_TOO_LONG;
 			pad -= chunk;
 		}
 
+		return SRWP_RANGE;
+
 	}
 
+	return SRWP_OK;
+
+}
+
+static uint8_t cmd_read(void) {
+
+	uint32_t addr, len;
+	if (!srwp_read_u32(&addr)) return SRWP_MALFORMED;
+	if (!srwp_read_u32(&len)) return SRWP_MALFORMED;
+	if (len > SRWP_FRAM_SIZE) return SRWP_MALFORMED;	// clearly malformed -- abort
+
+	return read_range(addr, len);
+
 }
 
 // CMD_WRITE: always fully drains `len` bytes from the input stream
@@ -245,32 +428,39 @@ static void cmd_read(void) {
 // protocol gives no way to signal a partial failure (this command has
 // no reply at all), so out-of-range bytes are simply discarded rather
 // than written, while still being consumed so the byte stream stays
-// in sync for whatever command comes next.
-static void cmd_write(void) {
-
-	uint32_t addr, len;
-	if (!srwp_read_u32(&addr)) return;
-	if (!srwp_read_u32(&len)) return;
-	if (len > SRWP_FRAM_SIZE) return;	// clearly malformed -- abort
-										// (nothing received yet to drain)
+// in sync for whatever command comes next. In v2 the reply is empty
+// and the status says SRWP_RANGE if anything was discarded.
+//
+// write_range() takes the `len` data bytes that follow the body's
+// header, shared with CMD_WRITEV the same way read_range() is.
+static uint8_t write_range(uint32_t addr, uint32_t len) {
 
 	uint32_t offset = 0;
 	bool wrote_anything = false;
+	uint8_t status = SRWP_OK;
 
 	while (offset < len) {
 
 		uint32_t chunk = len - offset;
 		if (chunk > SRWP_CHUNK_SIZE) chunk = SRWP_CHUNK_SIZE;
 
-		if (!srwp_read_bytes(chunk_buf, chunk)) return;
+		if (!srwp_read_bytes(chunk_buf, chunk)) {
+			status = SRWP_MALFORMED;
+			break;
+		}
 
-		for (uint32_t i = 0; i < chunk; i++) {
-			uint32_t byte_addr = addr + offset + i;
-			if (byte_addr < SRWP_FRAM_SIZE) {
-				fram_write((int)byte_addr, chunk_buf[i]);
-				wrote_anything = true;
-			}
+		// only the in-bounds prefix of this chunk (if any) is
+		// written, as a single burst -- overflow-safe the same way
+		// cmd_read()'s own bounds check is
+		uint32_t chunk_addr = addr + offset;
+		uint32_t valid = 0;
+		if (addr < SRWP_FRAM_SIZE && offset < SRWP_FRAM_SIZE - addr) {
+			uint32_t avail = SRWP_FRAM_SIZE - chunk_addr;
+			valid = chunk < avail ? chunk : avail;
+			fram_write_range((int)chunk_addr, chunk_buf, (int)valid);
+			wrote_anything = true;
 		}
+		if (valid < chunk) status = SRWP_RANGE;
 
 		offset += chunk;
 
@@ -278,52 +468,870 @@ static void cmd_write(void) {
 
 	if (wrote_anything) editor_notify_srwp_write();
 
+	return status;
+
 }
 
-// CMD_SIZE (firmware-specific extension): reports the full physical
-// chip capacity, matching SRWP's raw, encryption-unaware access model
-// -- deliberately not the smaller, metadata-excluded FRAM_AVAILABLE
-// figure used elsewhere in the firmware.
-static void cmd_size(void) {
-	srwp_write_u32(SRWP_FRAM_SIZE);
+static uint8_t cmd_write(void) {
+
+	uint32_t addr, len;
+	if (!srwp_read_u32(&addr)) return SRWP_MALFORMED;
+	if (!srwp_read_u32(&len)) return SRWP_MALFORMED;
+	if (len > SRWP_FRAM_SIZE) return SRWP_MALFORMED;	// clearly malformed -- abort
+														// (nothing received yet
+														// to drain)
+
+	return write_range(addr, len);
+
 }
 
-void srwp(void) {
+// ---- vectored: CMD_READV, CMD_WRITEV ----
+//
+// A list of ranges in one command, for a host after a header here and
+// a few records there: one exchange per batch instead of one per
+// range. Each segment follows exactly CMD_READ's or CMD_WRITE's rules
+// -- the same abort on an absurd length, the same zero padding and
+// discarding past the end of the chip.
 
-	blaustahl_led(LED_IDLE);
+// most segments in one vectored command -- also what sizes the table
+// CMD_READV parses its list into
+#define SRWP_VEC_MAX 64
+
+static uint32_t vec_addr[SRWP_VEC_MAX];
+static uint32_t vec_len[SRWP_VEC_MAX];
+
+// CMD_READV: <count:u32> (<addr:u32> <len:u32>) x count -> every
+// segment's bytes, back to back. The whole list is read and checked
+// before any data goes out, so a malformed segment anywhere aborts
+// the command with nothing sent -- never a reply cut short that a
+// host would sit waiting on the rest of.
+static uint8_t cmd_readv(void) {
+
+	uint32_t count;
+	if (!srwp_read_u32(&count)) return SRWP_MALFORMED;
+	if (count > SRWP_VEC_MAX) return SRWP_MALFORMED;	// clearly malformed -- abort
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (!srwp_read_u32(&vec_addr[i])) return SRWP_MALFORMED;
+		if (!srwp_read_u32(&vec_len[i])) return SRWP_MALFORMED;
+		if (vec_len[i] > SRWP_FRAM_SIZE) return SRWP_MALFORMED;
+	}
+
+	uint8_t status = SRWP_OK;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t st = read_range(vec_addr[i], vec_len[i]);
+		if (st == SRWP_TOO_LONG) return st;
+		if (st == SRWP_RANGE) status = SRWP_RANGE;
+	}
+
+	return status;
+
+}
+
+// CMD_WRITEV: <count:u32> (<addr:u32> <len:u32> <data:len>) x count,
+// no reply -- each segment a CMD_WRITE body, written as it streams
+// in. Unlike CMD_READV that means a malformed segment aborts with the
+// ones before it already written, exactly as if they'd been separate
+// CMD_WRITEs; v2 checks the whole payload first (frame_body_ok()), so
+// there nothing is written at all.
+static uint8_t cmd_writev(void) {
+
+	uint32_t count;
+	if (!srwp_read_u32(&count)) return SRWP_MALFORMED;
+	if (count > SRWP_VEC_MAX) return SRWP_MALFORMED;	// clearly malformed -- abort
+
+	uint8_t status = SRWP_OK;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t addr, len;
+		if (!srwp_read_u32(&addr)) return SRWP_MALFORMED;
+		if (!srwp_read_u32(&len)) return SRWP_MALFORMED;
+		if (len > SRWP_FRAM_SIZE) return SRWP_MALFORMED;
+		uint8_t st = write_range(addr, len);
+		if (st == SRWP_MALFORMED) return st;
+		if (st == SRWP_RANGE) status = SRWP_RANGE;
+	}
+
+	return status;
+
+}
+
+// ---- digests: CMD_CRC32, CMD_SHA256, CMD_MANIFEST ----
+//
+// All three hash exactly what CMD_READ would send for the same range
+// -- zeros for any part past the end of the chip -- so a host can
+// compare them against its own copy of the bytes without caring where
+// the chip ends. Same abort rule as CMD_READ for a malformed length.
+
+// smallest block CMD_MANIFEST will split the chip into. Bounds the
+// reply at 4 bytes per 64 of chip (16KB for a 256KB part); anything
+// smaller gets an empty manifest.
+#define SRWP_MANIFEST_MIN_BLOCK 64
+
+// fills chunk_buf with n bytes of the chip from addr + offset, zeros
+// for any of them past its end -- overflow-safe the same way
+// cmd_write()'s bounds check is. False if any were zeros.
+static bool chunk_fill(uint32_t addr, uint32_t offset, uint32_t n) {
+
+	uint32_t valid = 0;
+	if (addr < SRWP_FRAM_SIZE && offset < SRWP_FRAM_SIZE - addr) {
+		uint32_t avail = SRWP_FRAM_SIZE - addr - offset;
+		valid = n < avail ? n : avail;
+		fram_read((char *)chunk_buf, (int)(addr + offset), (int)valid);
+	}
+	memset(&chunk_buf[valid], 0, n - valid);
+
+	return valid == n;
+
+}
+
+// the standard CRC-32 (IEEE 802.3 -- zlib's crc32(), Python's
+// zlib.crc32()), through littlefs's lfs_crc(), which is the same CRC
+// without the inversions at either end. *in_range is cleared if any
+// of the range was past the chip.
+static uint32_t range_crc32(uint32_t addr, uint32_t len, bool *in_range) {
+
+	uint32_t crc = 0xffffffff;
+
+	for (uint32_t offset = 0; offset < len; ) {
+		uint32_t chunk = len - offset;
+		if (chunk > SRWP_CHUNK_SIZE) chunk = SRWP_CHUNK_SIZE;
+		if (!chunk_fill(addr, offset, chunk)) *in_range = false;
+		crc = lfs_crc(crc, chunk_buf, chunk);
+		offset += chunk;
+	}
+
+	return crc ^ 0xffffffff;
+
+}
+
+// CMD_CRC32: <addr:u32> <len:u32> -> <crc:u32>
+static uint8_t cmd_crc32(void) {
+
+	uint32_t addr, len;
+	if (!srwp_read_u32(&addr)) return SRWP_MALFORMED;
+	if (!srwp_read_u32(&len)) return SRWP_MALFORMED;
+	if (len > SRWP_FRAM_SIZE) return SRWP_MALFORMED;	// clearly malformed -- abort
+
+	bool in_range = true;
+	if (!srwp_write_u32(range_crc32(addr, len, &in_range))) return SRWP_TOO_LONG;
+
+	return in_range ? SRWP_OK : SRWP_RANGE;
+
+}
+
+// CMD_SHA256: <addr:u32> <len:u32> -> <digest:32 bytes>. For when a
+// CRC's odds of missing a change aren't good enough -- a whole-chip
+// "has anything changed at all?" check, say. There's no error reply
+// in this protocol, so a digest that couldn't be computed (the PSA
+// hash failing, which it has no reason to) comes back as 32 zero
+// bytes -- and in v2, as SRWP_FAILED.
+static uint8_t cmd_sha256(void) {
+
+	uint32_t addr, len;
+	if (!srwp_read_u32(&addr)) return SRWP_MALFORMED;
+	if (!srwp_read_u32(&len)) return SRWP_MALFORMED;
+	if (len > SRWP_FRAM_SIZE) return SRWP_MALFORMED;	// clearly malformed -- abort
+
+	uint8_t digest[32];
+	crypt_hash_ctx_t ctx;
+	bool ok = crypt_hash_start(&ctx);
+	bool in_range = true;
+
+	for (uint32_t offset = 0; ok && offset < len; ) {
+		uint32_t chunk = len - offset;
+		if (chunk > SRWP_CHUNK_SIZE) chunk = SRWP_CHUNK_SIZE;
+		if (!chunk_fill(addr, offset, chunk)) in_range = false;
+		ok = crypt_hash_update(&ctx, chunk_buf, chunk);
+		offset += chunk;
+	}
+
+	if (!ok || !crypt_hash_finish(&ctx, digest)) {
+		memset(digest, 0, sizeof(digest));
+		ok = false;
+	}
+
+	if (!srwp_write_bytes(digest, sizeof(digest))) return SRWP_TOO_LONG;
+
+	if (!ok) return SRWP_FAILED;
+	return in_range ? SRWP_OK : SRWP_RANGE;
+
+}
+
+// CMD_MANIFEST: <block:u32> -> <count:u32> <crc:u32 x count>. The
+// CRC-32 of every block-sized piece of the chip, in order, the last
+// one short if block doesn't divide the chip size. A block below
+// SRWP_MANIFEST_MIN_BLOCK gets count 0 and nothing else -- unlike a
+// malformed length elsewhere, this is cheap to answer, and answering
+// means the host doesn't have to wait out a timeout to find out. (In
+// v2 it's SRWP_MALFORMED, and a manifest too big for one frame is
+// SRWP_TOO_LONG -- ask for bigger blocks.)
+static uint8_t cmd_manifest(void) {
+
+	uint32_t block;
+	if (!srwp_read_u32(&block)) return SRWP_MALFORMED;
+
+	uint32_t size = SRWP_FRAM_SIZE;
+	uint32_t count = 0;
+	if (block >= SRWP_MANIFEST_MIN_BLOCK)
+		count = size / block + (size % block ? 1 : 0);
+
+	if (!srwp_write_u32(count)) return SRWP_TOO_LONG;
+	if (!count) return SRWP_MALFORMED;
+
+	bool in_range = true;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t addr = i * block;
+		uint32_t len = size - addr < block ? size - addr : block;
+		if (!srwp_write_u32(range_crc32(addr, len, &in_range))) return SRWP_TOO_LONG;
+	}
+
+	return SRWP_OK;
+
+}
+
+// ---- flash files: CMD_FILE_* ----
+//
+// Every one of these replies in v1 too, unlike CMD_WRITE -- a flash
+// write can fail for reasons the host can't see coming (a full
+// partition, a name that isn't there), so each says whether it
+// worked. In v2 a failure is the frame's status instead, and the
+// payload is empty as for any other failure.
+
+// longest name the flash directory index holds (its 32-byte name
+// arrays, see flash_storage.c and flash_storage_file_info_range())
+#define SRWP_NAME_MAX 31
+
+// entries CMD_FILE_LIST fetches from the index per call
+#define SRWP_LIST_BATCH 8
+
+static char name_a[SRWP_NAME_MAX + 1];
+static char name_b[SRWP_NAME_MAX + 1];
+static char list_names[SRWP_LIST_BATCH][32];
+static uint32_t list_sizes[SRWP_LIST_BATCH];
+
+// a stream CMD_FILE_CREATE opened and CMD_FILE_CLOSE hasn't closed yet
+static bool file_stream_open = false;
+
+// an open stream with no CREATE or APPEND for this long belongs to a
+// host that went away: srwp_idle() abandons it, so the one streaming
+// writer (and the flash its temp file holds) goes back to XMODEM and
+// te. A v2 session's end abandons it straight away.
+#define SRWP_STREAM_IDLE_MS 2000
+
+static absolute_time_t file_stream_deadline;
+
+static void file_stream_abandon(void) {
+	if (!file_stream_open) return;
+	flash_storage_stream_abort();
+	file_stream_open = false;
+}
+
+static void file_stream_touch(void) {
+	file_stream_deadline = make_timeout_time_ms(SRWP_STREAM_IDLE_MS);
+}
+
+// <len:u8> <name:len> into out. The whole field is always consumed,
+// so a rejected name doesn't desync what follows it. *valid is false
+// for an empty name, one too long for the index, or one with a NUL or
+// '/' in it (the flash partition is one flat directory). False only
+// if the body ran short.
+static bool srwp_read_name(char *out, bool *valid) {
+
+	uint8_t len;
+	if (!srwp_read_bytes(&len, 1)) return false;
+
+	*valid = len > 0 && len <= SRWP_NAME_MAX;
+
+	for (uint32_t at = 0; at < len; ) {
+		uint32_t chunk = len - at;
+		if (chunk > SRWP_CHUNK_SIZE) chunk = SRWP_CHUNK_SIZE;
+		if (!srwp_read_bytes(chunk_buf, chunk)) return false;
+		for (uint32_t i = 0; *valid && i < chunk; i++) {
+			if (chunk_buf[i] == 0 || chunk_buf[i] == '/') *valid = false;
+			else out[at + i] = (char)chunk_buf[i];
+		}
+		at += chunk;
+	}
+
+	if (*valid) out[len] = 0;
+	return true;
+
+}
+
+// the one-byte <ok:u8> reply most of these end with, and the status
+// that goes with it
+static uint8_t file_reply(bool ok, uint8_t fail_status) {
+	uint8_t b = ok ? 1 : 0;
+	if (!srwp_write_bytes(&b, 1)) return SRWP_TOO_LONG;
+	return ok ? SRWP_OK : fail_status;
+}
+
+// CMD_FILE_LIST: <start:u32> <max:u32> -> <total:u32> <n:u32>, then n
+// x (<size:u32> <len:u8> <name:len>) from position start in the
+// listing -- the same order the browser shows. A host pages through a
+// big directory with start; in v2, max has to be small enough for the
+// reply to fit a frame (36 bytes an entry at most).
+static uint8_t cmd_file_list(void) {
+
+	uint32_t start, max;
+	if (!srwp_read_u32(&start)) return SRWP_MALFORMED;
+	if (!srwp_read_u32(&max)) return SRWP_MALFORMED;
+
+	uint32_t total = (uint32_t)flash_storage_file_count();
+	uint32_t n = start < total ? total - start : 0;
+	if (n > max) n = max;
+
+	if (!srwp_write_u32(total)) return SRWP_TOO_LONG;
+	if (!srwp_write_u32(n)) return SRWP_TOO_LONG;
+
+	for (uint32_t done = 0; done < n; ) {
+
+		int want = n - done < SRWP_LIST_BATCH ? (int)(n - done) : SRWP_LIST_BATCH;
+		int got = flash_storage_file_info_range((int)(start + done), want,
+			list_names, list_sizes);
+
+		for (int i = 0; i < want; i++) {
+			// the directory can't change under us mid-command, but a
+			// short batch would still leave a reply shorter than n
+			// promised -- pad it with empty entries rather than hang
+			// the host
+			uint8_t len = i < got ? (uint8_t)strlen(list_names[i]) : 0;
+			if (!srwp_write_u32(i < got ? list_sizes[i] : 0)) return SRWP_TOO_LONG;
+			if (!srwp_write_bytes(&len, 1)) return SRWP_TOO_LONG;
+			if (!srwp_write_bytes((const uint8_t *)list_names[i], len)) return SRWP_TOO_LONG;
+		}
+
+		done += want;
+
+	}
+
+	return SRWP_OK;
+
+}
+
+// CMD_FILE_STAT: <name> -> <found:u8> <size:u32>
+static uint8_t cmd_file_stat(void) {
+
+	bool valid;
+	if (!srwp_read_name(name_a, &valid)) return SRWP_MALFORMED;
+
+	uint32_t size = 0;
+	bool found = valid && flash_storage_file_size(name_a, &size);
 
-	int cmd = srwp_getchar_timeout(SRWP_BYTE_TIMEOUT_MS);
-	if (cmd < 0) return;	// host sent the marker but nothing followed
-							// in time -- give up quietly, no reply
-							// expected for an incomplete command
+	uint8_t b = found ? 1 : 0;
+	if (!srwp_write_bytes(&b, 1)) return SRWP_TOO_LONG;
+	if (!srwp_write_u32(size)) return SRWP_TOO_LONG;
+
+	if (!valid) return SRWP_MALFORMED;
+	return found ? SRWP_OK : SRWP_NOT_FOUND;
+
+}
+
+// CMD_FILE_READ: <name> <offset:u32> <len:u32> -> <got:u32> <data:got>.
+// got is len clipped at the end of the file (0 past it, or for a file
+// that isn't there). The data goes out straight from memory-mapped
+// flash where the file's laid out for it (flash_storage_map()), one
+// flash block at a time, through chunk_buf otherwise. got is promised
+// before the first byte is read, so a read that then fails is padded
+// out with zeros -- v2 reports it as SRWP_FAILED.
+static uint8_t cmd_file_read(void) {
+
+	bool valid;
+	uint32_t offset, len;
+	if (!srwp_read_name(name_a, &valid)) return SRWP_MALFORMED;
+	if (!srwp_read_u32(&offset)) return SRWP_MALFORMED;
+	if (!srwp_read_u32(&len)) return SRWP_MALFORMED;
+
+	uint32_t size = 0;
+	bool found = valid && flash_storage_file_size(name_a, &size);
+
+	uint32_t got = 0;
+	if (found && offset < size) got = size - offset < len ? size - offset : len;
+
+	if (!srwp_write_u32(got)) return SRWP_TOO_LONG;
+
+	bool ok = true;
+
+	for (uint32_t done = 0; done < got; ) {
+
+		const uint8_t *mapped;
+		uint32_t n;
+
+		if (ok && flash_storage_map(name_a, offset + done, &mapped, &n) && n) {
+			if (n > got - done) n = got - done;
+			if (!srwp_write_bytes(mapped, n)) return SRWP_TOO_LONG;
+			done += n;
+			continue;
+		}
+
+		n = got - done < SRWP_CHUNK_SIZE ? got - done : SRWP_CHUNK_SIZE;
+		uint32_t r = ok ? flash_storage_read(name_a, offset + done, (char *)chunk_buf, n) : 0;
+		if (r < n) {
+			memset(&chunk_buf[r], 0, n - r);
+			ok = false;
+		}
+		if (!srwp_write_bytes(chunk_buf, n)) return SRWP_TOO_LONG;
+		done += n;
+
+	}
+
+	if (!valid) return SRWP_MALFORMED;
+	if (!found) return SRWP_NOT_FOUND;
+	return ok ? SRWP_OK : SRWP_FAILED;
+
+}
+
+// CMD_FILE_CREATE: <name> -> <ok:u8>. Opens flash_storage's streaming
+// writer on name: CMD_FILE_APPEND then adds to it, and CMD_FILE_CLOSE
+// commits it, atomically replacing any file of that name. A stream
+// this left open (a host that went away mid-file) is abandoned first.
+// There's only one streaming writer, so while this one's open,
+// XMODEM uploads and te saves fail -- close it promptly. One left
+// open goes when a v2 session ends, or after SRWP_STREAM_IDLE_MS
+// without an append.
+static uint8_t cmd_file_create(void) {
+
+	bool valid;
+	if (!srwp_read_name(name_a, &valid)) return SRWP_MALFORMED;
+
+	file_stream_abandon();
+
+	if (valid) file_stream_open = flash_storage_stream_open(name_a);
+	file_stream_touch();
+
+	return file_reply(file_stream_open, valid ? SRWP_FAILED : SRWP_MALFORMED);
+
+}
+
+// CMD_FILE_APPEND: <len:u32> <data:len> -> <ok:u8>. All of data is
+// drained whatever happens, keeping the stream in sync. Once an append
+// fails the stream stays failed (see flash_storage_stream_append()),
+// and CMD_FILE_CLOSE will discard it.
+static uint8_t cmd_file_append(void) {
+
+	uint32_t len;
+	if (!srwp_read_u32(&len)) return SRWP_MALFORMED;
+
+	bool ok = file_stream_open;
+
+	for (uint32_t done = 0; done < len; ) {
+		uint32_t chunk = len - done < SRWP_CHUNK_SIZE ? len - done : SRWP_CHUNK_SIZE;
+		if (!srwp_read_bytes(chunk_buf, chunk)) return SRWP_MALFORMED;
+		if (ok) ok = flash_storage_stream_append((const char *)chunk_buf, chunk);
+		done += chunk;
+	}
+
+	file_stream_touch();	// from the end -- a long append is no
+							// sign of a host gone quiet
+
+	return file_reply(ok, SRWP_FAILED);
+
+}
+
+// CMD_FILE_CLOSE: <commit:u8> -> <ok:u8>. Commits the stream (the file
+// appears, or replaces the old one), or with commit 0 abandons it and
+// leaves any old file as it was.
+static uint8_t cmd_file_close(void) {
+
+	uint8_t commit;
+	if (!srwp_read_bytes(&commit, 1)) return SRWP_MALFORMED;
+
+	if (!file_stream_open) return file_reply(false, SRWP_FAILED);
+	file_stream_open = false;
+
+	if (!commit) {
+		flash_storage_stream_abort();
+		return file_reply(true, SRWP_FAILED);
+	}
+
+	bool ok = flash_storage_stream_close();
+	if (ok) editor_notify_srwp_flash_write();
+	return file_reply(ok, SRWP_FAILED);
+
+}
+
+// CMD_FILE_RENAME: <old name> <new name> -> <ok:u8>. Like the browser's
+// rename underneath (flash_storage_rename()), a file already called
+// new name is replaced.
+static uint8_t cmd_file_rename(void) {
+
+	bool valid_a, valid_b;
+	if (!srwp_read_name(name_a, &valid_a)) return SRWP_MALFORMED;
+	if (!srwp_read_name(name_b, &valid_b)) return SRWP_MALFORMED;
+
+	if (!valid_a || !valid_b) return file_reply(false, SRWP_MALFORMED);
+	if (flash_storage_find(name_a) < 0) return file_reply(false, SRWP_NOT_FOUND);
+
+	bool ok = flash_storage_rename(name_a, name_b);
+	if (ok) editor_notify_srwp_flash_write();
+	return file_reply(ok, SRWP_FAILED);
+
+}
+
+// CMD_FILE_DELETE: <name> -> <ok:u8>
+static uint8_t cmd_file_delete(void) {
+
+	bool valid;
+	if (!srwp_read_name(name_a, &valid)) return SRWP_MALFORMED;
+
+	if (!valid) return file_reply(false, SRWP_MALFORMED);
+	if (flash_storage_find(name_a) < 0) return file_reply(false, SRWP_NOT_FOUND);
+
+	bool ok = flash_storage_delete(name_a);
+	if (ok) editor_notify_srwp_flash_write();
+	return file_reply(ok, SRWP_FAILED);
+
+}
+
+// CMD_SIZE (firmware-specific extension): reports the full physical
+// chip capacity, matching SRWP's raw, encryption-unaware access model
+// -- deliberately not the smaller, metadata-excluded fram_available()
+// figure used elsewhere in the firmware. Whatever the chip reported
+// via RDID at boot, so a host can size its transfers from this alone.
+static uint8_t cmd_size(void) {
+	return srwp_write_u32(SRWP_FRAM_SIZE) ? SRWP_OK : SRWP_TOO_LONG;
+}
+
+// runs one command, v1 or v2 alike, with the LED showing which way
+// the data's going
+static uint8_t srwp_exec(uint8_t cmd) {
 
 	switch (cmd) {
 
 		case CMD_TEST:
-			cmd_test();
-			break;
+			return cmd_test();
 
 		case CMD_READ:
 			blaustahl_led(LED_READ);
-			cmd_read();
-			break;
+			return cmd_read();
 
 		case CMD_WRITE:
 			blaustahl_led(LED_WRITE);
-			cmd_write();
-			break;
+			return cmd_write();
+
+		case CMD_READV:
+			blaustahl_led(LED_READ);
+			return cmd_readv();
+
+		case CMD_WRITEV:
+			blaustahl_led(LED_WRITE);
+			return cmd_writev();
+
+		case CMD_FILE_LIST:
+			blaustahl_led(LED_READ);
+			return cmd_file_list();
+
+		case CMD_FILE_STAT:
+			blaustahl_led(LED_READ);
+			return cmd_file_stat();
+
+		case CMD_FILE_READ:
+			blaustahl_led(LED_READ);
+			return cmd_file_read();
+
+		case CMD_FILE_CREATE:
+			blaustahl_led(LED_WRITE);
+			return cmd_file_create();
+
+		case CMD_FILE_APPEND:
+			blaustahl_led(LED_WRITE);
+			return cmd_file_append();
+
+		case CMD_FILE_CLOSE:
+			blaustahl_led(LED_WRITE);
+			return cmd_file_close();
+
+		case CMD_FILE_RENAME:
+			blaustahl_led(LED_WRITE);
+			return cmd_file_rename();
+
+		case CMD_FILE_DELETE:
+			blaustahl_led(LED_WRITE);
+			return cmd_file_delete();
 
 		case CMD_SIZE:
 			blaustahl_led(LED_READ);
-			cmd_size();
-			break;
+			return cmd_size();
+
+		case CMD_CRC32:
+			blaustahl_led(LED_READ);
+			return cmd_crc32();
+
+		case CMD_SHA256:
+			blaustahl_led(LED_READ);
+			return cmd_sha256();
+
+		case CMD_MANIFEST:
+			blaustahl_led(LED_READ);
+			return cmd_manifest();
 
 		default:
 			// unknown command code -- nothing sensible to do without
 			// knowing its shape; matches the original's own safe
 			// default of simply not processing it further
-			break;
+			return SRWP_UNKNOWN;
+
+	}
+
+}
+
+// ---- v2: CMD_HELLO and the framed session ----
+//
+// A frame, either way:
+//
+//   <0xa5> <seq:u8> <op:u8> <len:u16> <payload:len> <crc:u32>
+//
+// op is the command in a request and the status in a reply, a reply
+// carries its request's seq, and the CRC-32 (zlib's, as CMD_CRC32)
+// covers seq through the end of the payload.
+
+// CMD_HELLO: <version:u8> <window:u8> -> <version:u8> <window:u8>
+// <frame_max:u16> <idle_ms:u16>. Settles on the lower of the two
+// versions and windows; true if that's v2, and the session should
+// start straight after this reply.
+static bool cmd_hello(void) {
+
+	uint8_t req[2];
+	if (!cdc_read_block(req, 2)) return false;
+
+	uint8_t version = req[0] < SRWP_VERSION ? req[0] : SRWP_VERSION;
+	if (version < 1) version = 1;
+	uint8_t window = req[1] < SRWP_WINDOW ? req[1] : SRWP_WINDOW;
+	if (window < 1 || version < 2) window = 1;
+
+	uint8_t reply[6] = {
+		version, window,
+		(uint8_t)(SRWP_FRAME_MAX & 0xff), (uint8_t)(SRWP_FRAME_MAX >> 8),
+		(uint8_t)(SRWP_SESSION_IDLE_MS & 0xff), (uint8_t)(SRWP_SESSION_IDLE_MS >> 8),
+	};
+	if (!cdc_write_block(reply, sizeof(reply))) return false;
+
+	return version == 2;
+
+}
+
+static uint32_t frame_crc(const uint8_t *hdr, const uint8_t *payload, uint32_t len) {
+	uint32_t crc = lfs_crc(0xffffffff, hdr, 4);
+	return lfs_crc(crc, payload, len) ^ 0xffffffff;
+}
+
+static bool frame_send(uint8_t seq, uint8_t status, const uint8_t *payload, uint32_t len) {
+
+	uint8_t hdr[5] = { SRWP_SOF, seq, status, (uint8_t)(len & 0xff), (uint8_t)(len >> 8) };
+	uint8_t crc[4];
+	put_le32(crc, frame_crc(&hdr[1], payload, len));
+
+	return cdc_write_block(hdr, sizeof(hdr))
+		&& cdc_write_block(payload, len)
+		&& cdc_write_block(crc, sizeof(crc));
+
+}
+
+// walks a CMD_WRITEV body's segments: true if they add up to exactly
+// len bytes
+static bool writev_body_ok(const uint8_t *p, uint32_t len) {
+
+	if (len < 4) return false;
+	uint32_t count = get_le32(p);
+	if (count > SRWP_VEC_MAX) return false;
+
+	uint32_t at = 4;
+	for (uint32_t i = 0; i < count; i++) {
+		if (len - at < 8) return false;
+		uint32_t n = get_le32(&p[at + 4]);
+		at += 8;
+		if (n > len - at) return false;
+		at += n;
+	}
+
+	return at == len;
+
+}
+
+// where a <len:u8> <name> field starting at p[at] ends, or -1 if it
+// runs past len
+static long name_field_end(const uint8_t *p, uint32_t len, long at) {
+	if (at < 0 || (uint32_t)at >= len) return -1;
+	uint32_t end = (uint32_t)at + 1 + p[at];
+	return end <= len ? (long)end : -1;
+}
+
+// whether a request's payload is exactly the body its command takes --
+// so nothing runs on a truncated one, or one with something tacked on
+// -- or -1 for a command v2 doesn't have
+static int frame_body_ok(uint8_t cmd, const uint8_t *p, uint32_t len) {
+
+	switch (cmd) {
+		case CMD_READV:		return len >= 4 && get_le32(p) <= SRWP_VEC_MAX
+								&& len - 4 == get_le32(p) * 8;
+		case CMD_WRITEV:	return writev_body_ok(p, len);
+		case CMD_FILE_LIST:	return len == 8;
+		case CMD_FILE_STAT:
+		case CMD_FILE_CREATE:
+		case CMD_FILE_DELETE:	return name_field_end(p, len, 0) == (long)len;
+		case CMD_FILE_READ:	{
+			long end = name_field_end(p, len, 0);
+			return end >= 0 && len - (uint32_t)end == 8;
+		}
+		case CMD_FILE_APPEND:	return len >= 4 && len - 4 == get_le32(p);
+		case CMD_FILE_CLOSE:	return len == 1;
+		case CMD_FILE_RENAME:	return name_field_end(p, len,
+									name_field_end(p, len, 0)) == (long)len;
+		case CMD_TEST:		return len >= 4 && len - 4 == get_le32(p);
+		case CMD_WRITE:		return len >= 8 && len - 8 == get_le32(&p[4]);
+		case CMD_READ:
+		case CMD_CRC32:
+		case CMD_SHA256:	return len == 8;
+		case CMD_MANIFEST:	return len == 4;
+		case CMD_SIZE:
+		case CMD_BYE:		return len == 0;
+		default:			return -1;
+	}
+
+}
+
+// waits for the next frame's start byte, dropping anything else on
+// the way -- which is also how the parser finds its feet again after a
+// bad frame. False once the session has been idle too long.
+static bool frame_wait_start(void) {
+
+	absolute_time_t idle = make_timeout_time_ms(SRWP_SESSION_IDLE_MS);
 
+	while (!time_reached(idle)) {
+		uint8_t b;
+		if (tud_cdc_connected() && tud_cdc_available()
+			&& tud_cdc_read(&b, 1) == 1 && b == SRWP_SOF)
+			return true;
 	}
 
+	return false;
+
+}
+
+// drops input until the host has been quiet for SRWP_PURGE_MS
+static void frame_purge(void) {
+
+	absolute_time_t quiet = make_timeout_time_ms(SRWP_PURGE_MS);
+
+	while (!time_reached(quiet)) {
+		if (tud_cdc_connected() && tud_cdc_available()
+			&& tud_cdc_read(chunk_buf, sizeof(chunk_buf)))
+			quiet = make_timeout_time_ms(SRWP_PURGE_MS);
+	}
+
+}
+
+// Runs requests until CMD_BYE or the idle timeout, strictly in order.
+// A bad frame or one out of order isn't run: it gets a NAK naming the
+// seq expected next, and everything after it is ignored until that
+// seq turns up -- the host resends from there (go-back-N). Only one
+// NAK goes out per gap, however many frames land in it. Replies are
+// flushed once nothing more is waiting, so a pipelined burst goes out
+// in full packets.
+static void srwp_session(void) {
+
+	uint8_t expect = 0;
+	bool nak_sent = false;
+
+	while (frame_wait_start()) {
+
+		uint8_t hdr[4];
+		if (!cdc_read_block(hdr, sizeof(hdr))) return;
+
+		uint8_t seq = hdr[0];
+		uint8_t cmd = hdr[1];
+		uint32_t len = (uint32_t)hdr[2] | ((uint32_t)hdr[3] << 8);
+
+		bool good = len <= SRWP_FRAME_MAX;
+		if (good) {
+			uint8_t crc[4];
+			if (!cdc_read_block(req_buf, len)) return;
+			if (!cdc_read_block(crc, sizeof(crc))) return;
+			good = get_le32(crc) == frame_crc(hdr, req_buf, len);
+		}
+
+		if (!good || seq != expect) {
+			if (!nak_sent) {
+				frame_send(expect, good ? SRWP_BAD_SEQ : SRWP_BAD_FRAME, NULL, 0);
+				tud_cdc_write_flush();
+				nak_sent = true;
+			}
+			if (!good) frame_purge();
+			continue;
+		}
+
+		nak_sent = false;
+		expect++;
+
+		if (cmd == CMD_BYE) {
+			frame_send(seq, SRWP_OK, NULL, 0);
+			return;
+		}
+
+		uint8_t status;
+		int body_ok = frame_body_ok(cmd, req_buf, len);
+		reply_len = 0;
+
+		if (body_ok < 0) {
+			status = SRWP_UNKNOWN;
+		} else if (!body_ok) {
+			status = SRWP_MALFORMED;
+		} else {
+			in_frame = true;
+			body = req_buf;
+			body_left = len;
+			status = srwp_exec(cmd);
+			in_frame = false;
+		}
+
+		// a failed command's partial reply means nothing
+		if (status != SRWP_OK && status != SRWP_RANGE) reply_len = 0;
+
+		if (!frame_send(seq, status, reply_buf, reply_len)) return;
+		if (!tud_cdc_available()) tud_cdc_write_flush();
+
+	}
+
+}
+
+void srwp(void) {
+
+	blaustahl_led(LED_IDLE);
+
+	// whatever the editor has typed but core0 hasn't written out yet
+	// lands before a host sees (or overwrites) the chip -- reads would
+	// see it anyway, but a host that reads and then unplugs is owed
+	// durable data, and a write must land after, not before, it
+	fram_flush();
+
+	uint8_t cmd;
+	if (!cdc_read_block(&cmd, 1)) return;	// host sent the marker but
+											// nothing followed in time --
+											// give up quietly, no reply
+											// expected for an incomplete
+											// command
+
+	if (cmd == CMD_HELLO) {
+		if (cmd_hello()) {
+			tud_cdc_write_flush();
+			srwp_session();
+			file_stream_abandon();	// whether by BYE or by timeout,
+									// nobody is left to close it
+		}
+	} else {
+		srwp_exec(cmd);		// v1 has nowhere to put the status
+	}
+
+	// whatever's left of the reply short of a full packet
+	tud_cdc_write_flush();
+
+}
+
+// called while the UI idles: abandons a flash file stream whose host
+// has gone quiet (see SRWP_STREAM_IDLE_MS)
+void srwp_idle(void) {
+	if (file_stream_open && time_reached(file_stream_deadline))
+		file_stream_abandon();
 }
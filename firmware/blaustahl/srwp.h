@@ -5,4 +5,8 @@
 // for the full protocol description, hardening notes, and rationale.
 void srwp(void);
 
+// between commands, from the UI's idle loop -- lets go of a flash file
+// stream a host opened and then stopped feeding
+void srwp_idle(void);
+
 #endif
@@ -4,10 +4,12 @@
  *
  * FRAM access is real (wraps fram_read/fram_write). SRAM is a fixed-size
  * in-memory scratchpad. Flash access is real too, via flash_storage.c's
- * littlefs backend, but view-only.
+ * littlefs backend -- writable only in ranges (in place, see
+ * flash_storage_write_range()), which in the grid editor means always
+ * through buffer mode.
  *
  * FRAM encryption (ChaCha20-Poly1305 via crypt.c) is layered entirely
- * inside storage_buffer_enter()/storage_buffer_commit() -- everything
+ * inside buffer mode's page loads and storage_buffer_commit() -- everything
  * else (storage_read/storage_write, the grid engine in editor.c) stays
  * completely unaware encryption exists. Metadata (LTSF format) is
  * cached in RAM after first load, since it's read/checked on nearly
@@ -22,14 +24,15 @@
 
 #include "blaustahl.h"
 #include "fram.h"
+#include "fram_dma.h"
 #include "flash_storage.h"
 #include "crypt.h"
 #include "ltsf.h"
 #include "storage.h"
 
-#define SRAM_DISK_SIZE 7680		// matches FRAM_AVAILABLE for now, by
-								// deliberate choice, not by structural
-								// necessity -- they're independent constants
+#define SRAM_DISK_SIZE 7680		// matches an 8KB FRAM's available region,
+								// by deliberate choice, not by structural
+								// necessity -- they're independent
 static uint8_t sram_disk[SRAM_DISK_SIZE];
 
 file_ref_t current_file;
@@ -103,7 +106,7 @@ file_ref_t storage_fram_ref(void) {
 	f.index = 0;
 	strncpy(f.name, "FRAM", STORAGE_NAME_LEN - 1);
 	f.name[STORAGE_NAME_LEN - 1] = 0;
-	f.size = FRAM_AVAILABLE;
+	f.size = fram_available();
 
 	return f;
 
@@ -155,6 +158,14 @@ bool storage_flash_file_exists(const char *name) {
 	return flash_storage_file_size(name, &size);
 }
 
+bool storage_flash_find(const char *name, file_ref_t *out) {
+	ensure_storage_ready();
+	int idx = flash_storage_find(name);
+	if (idx < 0) return false;
+	*out = storage_file_at(idx);
+	return strcmp(out->name, name) == 0;
+}
+
 bool storage_flash_rename(const char *old_name, const char *new_name) {
 	ensure_storage_ready();
 	return flash_storage_rename(old_name, new_name);
@@ -165,6 +176,34 @@ bool storage_flash_delete(const char *name) {
 	return flash_storage_delete(name);
 }
 
+// background flash maintenance, only once flash is in use anyway --
+// never the thing that mounts it (see storage_init())
+bool storage_idle(bool (*input_pending)(void)) {
+	if (!storage_ready) return false;
+	return flash_storage_idle(input_pending);
+}
+
+bool storage_flash_stream_open(const char *name) {
+	ensure_storage_ready();
+	return flash_storage_stream_open(name);
+}
+
+bool storage_flash_stream_append(const char *data, uint32_t len) {
+	return flash_storage_stream_append(data, len);
+}
+
+bool storage_flash_stream_truncate(uint32_t len) {
+	return flash_storage_stream_truncate(len);
+}
+
+bool storage_flash_stream_close(void) {
+	return flash_storage_stream_close();
+}
+
+void storage_flash_stream_abort(void) {
+	flash_storage_stream_abort();
+}
+
 // ---- LTSF metadata (encryption state), cached after first load ----
 
 static ltsf_meta_t meta;
@@ -173,7 +212,7 @@ static bool meta_loaded = false;
 static void ltsf_load_meta(ltsf_meta_t *m) {
 
 	uint8_t mbuf[LTSF_META_SIZE];
-	fram_read((char *)mbuf, FRAM_AVAILABLE, LTSF_META_SIZE);
+	fram_read((char *)mbuf, fram_available(), LTSF_META_SIZE);
 
 	memcpy(&m->magic, &mbuf[0], 2);
 	memcpy(&m->version, &mbuf[2], 1);
@@ -183,6 +222,8 @@ static void ltsf_load_meta(ltsf_meta_t *m) {
 	memcpy(m->salt, &mbuf[52], 16);
 	memcpy(m->nonce, &mbuf[68], 12);
 	memcpy(m->tag, &mbuf[92], 16);
+	memcpy(&m->sector_units, &mbuf[108], 2);
+	memcpy(&m->sector_count, &mbuf[110], 1);
 	memcpy(&m->bootctr, &mbuf[124], 4);
 
 }
@@ -199,13 +240,67 @@ static void ltsf_save_meta(const ltsf_meta_t *m) {
 	memcpy(&mbuf[52], m->salt, 16);
 	memcpy(&mbuf[68], m->nonce, 12);
 	memcpy(&mbuf[92], m->tag, 16);
+	memcpy(&mbuf[108], &m->sector_units, 2);
+	memcpy(&mbuf[110], &m->sector_count, 1);
 	memcpy(&mbuf[124], &m->bootctr, 4);
 
-	for (int i = 0; i < LTSF_META_SIZE; i++)
-		fram_write(FRAM_AVAILABLE + i, mbuf[i]);
+	fram_write_range(fram_available(), mbuf, LTSF_META_SIZE);
 
 }
 
+// v1 sector table, cached alongside the header. Only meaningful while
+// meta.version == LTSF_VERSION_SECTORED and FRAM is encrypted.
+static ltsf_sector_t sectors[LTSF_MAX_SECTORS];
+
+static uint32_t ltsf_sector_rec_addr(uint32_t idx) {
+	return fram_available() + LTSF_SECTOR_REC_OFFSET + idx * LTSF_SECTOR_REC_SIZE;
+}
+
+static void ltsf_load_sectors(void) {
+
+	uint8_t rec[LTSF_SECTOR_REC_SIZE];
+	uint32_t n = meta.sector_count;
+	if (n > LTSF_MAX_SECTORS) n = LTSF_MAX_SECTORS;
+
+	for (uint32_t i = 0; i < n; i++) {
+		fram_read((char *)rec, ltsf_sector_rec_addr(i), sizeof(rec));
+		memcpy(&sectors[i].counter, &rec[0], 4);
+		memcpy(sectors[i].tag, &rec[4], 16);
+	}
+
+}
+
+static void ltsf_save_sector(uint32_t idx) {
+
+	uint8_t rec[LTSF_SECTOR_REC_SIZE];
+	memcpy(&rec[0], &sectors[idx].counter, 4);
+	memcpy(&rec[4], sectors[idx].tag, 16);
+	fram_write_range(ltsf_sector_rec_addr(idx), rec, sizeof(rec));
+
+}
+
+// v1 geometry for this chip -- see ltsf.h
+static void ltsf_sector_geometry(uint32_t avail, uint16_t *units, uint8_t *count) {
+	uint32_t per = (avail + LTSF_MAX_SECTORS - 1) / LTSF_MAX_SECTORS;
+	uint32_t u = (per + LTSF_SECTOR_UNIT - 1) / LTSF_SECTOR_UNIT;
+	if (u == 0) u = 1;
+	uint32_t bytes = u * LTSF_SECTOR_UNIT;
+	*units = (uint16_t)u;
+	*count = (uint8_t)((avail + bytes - 1) / bytes);
+}
+
+static uint32_t ltsf_sector_bytes(void) {
+	return (uint32_t)meta.sector_units * LTSF_SECTOR_UNIT;
+}
+
+// content-region span of sector idx (the last one may be short)
+static void ltsf_sector_span(uint32_t idx, uint32_t *off, uint32_t *len) {
+	uint32_t ss = ltsf_sector_bytes();
+	uint32_t avail = fram_available();
+	*off = idx * ss;
+	*len = (*off + ss <= avail) ? ss : avail - *off;
+}
+
 static void ensure_meta_loaded(void) {
 
 	if (meta_loaded) return;
@@ -225,6 +320,10 @@ static void ensure_meta_loaded(void) {
 		strncpy((char *)meta.plaindesc, "plaintext", sizeof(meta.plaindesc) - 1);
 	}
 
+	if (meta.algo != LTSF_ALGO_PLAINTEXT &&
+			meta.version == LTSF_VERSION_SECTORED)
+		ltsf_load_sectors();
+
 	meta.bootctr += 1;
 	ltsf_save_meta(&meta);
 
@@ -246,50 +345,209 @@ crypt_status_t storage_crypt_status(void) {
 bool storage_can_write(file_ref_t f) {
 	if (f.kind == STORAGE_SRAM) return true;
 	if (f.kind == STORAGE_FRAM) return storage_crypt_status() != CRYPT_LOCKED;
-	return false;
+	return true;	// flash: in ranges only, see storage_write_raw()
 }
 
 // ---- buffer mode state ----
 
-#define WRITE_BUFFER_SIZE 7680		// >= both FRAM_AVAILABLE and SRAM_DISK_SIZE
-
-// TWO independent buffers, one per bufferable storage kind (FRAM and
-// SRAM) -- not a single shared buffer keyed to whichever file happens
-// to be "current". This is what lets you switch back and forth
-// between FRAM and SRAM in the grid editor with unsaved changes
-// pending on either or both sides: switching no longer discards
-// anything, since each kind's edits live in their own buffer,
-// independent of what's currently selected. The combined cost is two
-// 7680-byte buffers (15360 bytes total) -- trivial against the
-// RP2040's 264KB of RAM, especially next to the 64KB XMODEM staging
-// buffer already in use elsewhere in this firmware.
+// Buffer mode is a page-granular overlay over the backend rather than
+// a copy of the whole file: entering it copies nothing, reads fall
+// through to the backend for any page that hasn't been written, and
+// the first write into a page materializes just that page -- so
+// entering is O(1), and RAM scales with how much is being edited, not
+// with the size of the part (a 256KB Kaltstahl buffers the same way an
+// 8KB Blaustahl does).
+//
+// FRAM and SRAM each still have their own independent buffer -- which
+// is what lets you switch back and forth between them in the grid
+// editor with unsaved changes pending on either or both sides -- and
+// so does flash, for one file at a time (buffer_for()), but
+// the pages themselves come from ONE shared pool, tagged with the
+// buffer that owns them: whichever side is being edited gets the RAM.
+// A commit leaves its pages in place, clean, as a cache; clean pages
+// are recycled least-recently-used first when a new page is needed.
+// Only when every page in the pool is dirty does a write fail
+// (storage_buffer_full()) -- commit, and editing can carry on.
+//
+// Within each page, which parts have been written since the last
+// commit is tracked as a bitmap of DIRTY_CHUNK-byte chunks, so a
+// commit writes back only what actually changed, each run of adjacent
+// dirty chunks as a single burst -- a typical edit of a few dozen
+// bytes costs one or two short transactions. 32 bytes is a deliberate
+// middle ground: small enough that one edited byte doesn't drag much
+// unchanged data along with it, large enough that a line's worth of
+// typing coalesces into a couple of runs.
+//
+// BUFFER_POOL_PAGES is a CMake cache variable; the default of 64 (16KB)
+// is about what the two old flat 7680-byte buffers cost together.
+#define BUFFER_PAGE 256
+#define DIRTY_CHUNK 32
+#ifndef BUFFER_POOL_PAGES
+#define BUFFER_POOL_PAGES 64
+#endif
+
 typedef struct {
-	uint8_t data[WRITE_BUFFER_SIZE];
+	uint8_t data[BUFFER_PAGE];
+	uint32_t page_no;		// offset / BUFFER_PAGE within the owner's file
+	uint32_t last_use;		// for LRU recycling of clean pages
+	uint32_t ticket;		// fram_dma ticket of an async commit still
+							// reading data[], 0 if none
+	int8_t owner;			// storage_kind_t of the owning buffer, -1 = free
+	uint8_t dirty_map;		// one bit per DIRTY_CHUNK, BUFFER_PAGE / 32 = 8
+} buffer_page_t;
+
+typedef struct {
+	storage_kind_t kind;
+	file_ref_t file;		// what the overlay sits on top of
 	uint32_t len;
 	bool active;
 	bool dirty;
+	bool full;				// a write was refused for lack of pages
+	buffer_page_t *last;	// most recent hit -- keystrokes and row
+							// reads land on the same page in a row
 } write_buffer_t;
 
-static write_buffer_t fram_buffer;
-static write_buffer_t sram_buffer;
+static buffer_page_t page_pool[BUFFER_POOL_PAGES];
+static uint32_t page_clock = 0;
+static bool page_pool_ready = false;
+
+static write_buffer_t fram_buffer = { .kind = STORAGE_FRAM };
+static write_buffer_t sram_buffer = { .kind = STORAGE_SRAM };
+static write_buffer_t flash_buffer = { .kind = STORAGE_FLASH };
 
 static write_buffer_t *buffer_for_kind(storage_kind_t kind) {
 	if (kind == STORAGE_FRAM) return &fram_buffer;
 	if (kind == STORAGE_SRAM) return &sram_buffer;
+	if (kind == STORAGE_FLASH) return &flash_buffer;
+	return NULL;
+}
+
+// the buffer a read or write of f goes through, if any: FRAM and SRAM
+// are one file each, but the flash buffer only ever covers the one
+// flash file it was entered on -- every other flash file reads and
+// writes straight through
+static write_buffer_t *buffer_for(file_ref_t f) {
+	write_buffer_t *b = buffer_for_kind(f.kind);
+	if (b && b->active && f.kind == STORAGE_FLASH &&
+			strcmp(b->file.name, f.name) != 0)
+		return NULL;
+	return b;
+}
+
+static void page_pool_init(void) {
+	if (page_pool_ready) return;
+	for (int i = 0; i < BUFFER_POOL_PAGES; i++) page_pool[i].owner = -1;
+	page_pool_ready = true;
+}
+
+// an async commit may still be streaming a page out of RAM -- it has
+// to finish before the page's memory is handed to anything else
+static void page_settle(buffer_page_t *pg) {
+	if (pg->ticket) {
+		fram_dma_wait(pg->ticket);
+		pg->ticket = 0;
+	}
+}
+
+static buffer_page_t *page_find(write_buffer_t *b, uint32_t page_no) {
+
+	if (b->last && b->last->owner == (int8_t)b->kind &&
+			b->last->page_no == page_no) {
+		b->last->last_use = ++page_clock;
+		return b->last;
+	}
+
+	for (int i = 0; i < BUFFER_POOL_PAGES; i++) {
+		buffer_page_t *pg = &page_pool[i];
+		if (pg->owner == (int8_t)b->kind && pg->page_no == page_no) {
+			pg->last_use = ++page_clock;
+			b->last = pg;
+			return pg;
+		}
+	}
+
 	return NULL;
+
+}
+
+// a free page, or else the least recently used clean one (from either
+// buffer). NULL if every page holds unsaved edits.
+static buffer_page_t *page_alloc(write_buffer_t *b, uint32_t page_no) {
+
+	page_pool_init();
+
+	buffer_page_t *victim = NULL;
+	for (int i = 0; i < BUFFER_POOL_PAGES; i++) {
+		buffer_page_t *pg = &page_pool[i];
+		if (pg->owner < 0) { victim = pg; break; }
+		if (pg->dirty_map) continue;
+		if (!victim || pg->last_use < victim->last_use) victim = pg;
+	}
+	if (!victim) return NULL;
+
+	page_settle(victim);
+	if (victim->owner >= 0) {
+		write_buffer_t *prev = buffer_for_kind((storage_kind_t)victim->owner);
+		if (prev->last == victim) prev->last = NULL;
+	}
+	victim->owner = (int8_t)b->kind;
+	victim->page_no = page_no;
+	victim->dirty_map = 0;
+	victim->last_use = ++page_clock;
+	b->last = victim;
+	return victim;
+
+}
+
+static void page_free(write_buffer_t *b, buffer_page_t *pg) {
+	page_settle(pg);
+	pg->owner = -1;
+	pg->dirty_map = 0;
+	if (b->last == pg) b->last = NULL;
+}
+
+// drops every page b owns, e.g. on exit or once its backend content
+// has been rewritten from underneath it
+static void buffer_drop_pages(write_buffer_t *b) {
+	page_pool_init();
+	for (int i = 0; i < BUFFER_POOL_PAGES; i++)
+		if (page_pool[i].owner == (int8_t)b->kind) page_free(b, &page_pool[i]);
+}
+
+static void buffer_mark_clean(write_buffer_t *b) {
+	for (int i = 0; i < BUFFER_POOL_PAGES; i++)
+		if (page_pool[i].owner == (int8_t)b->kind) page_pool[i].dirty_map = 0;
+	b->dirty = false;
+	b->full = false;
 }
 
 // shared scratch for ciphertext+tag staging (encrypt output / decrypt
-// input) -- static, not stack-allocated, deliberately: core1's stack
-// budget is unknown/likely small, and 7680+16 bytes on the stack is a
-// real overflow risk. Reused across enable/unlock/disable/buffer
-// commit -- never called concurrently (single-threaded core1). Only
-// FRAM is ever encrypted, so this stays one shared scratch buffer
-// even with two independent write buffers now.
-#define CRYPT_SCRATCH_SIZE (FRAM_AVAILABLE + 16)
+// input), and for the matching plaintext -- static, not
+// stack-allocated, deliberately: core1's stack budget is
+// unknown/likely small, and a whole image on the stack is a real
+// overflow risk. Reused across enable/unlock/change/disable, buffer
+// page loads and commits -- never called concurrently (single-threaded
+// core1). Only FRAM is ever encrypted, so one pair serves everything.
+//
+// FRAM's size is only known at runtime (fram_init() reads it from the
+// chip), and the whole-image operations -- enabling, migrating,
+// re-keying and disabling encryption -- hold the entire
+// FRAM content in RAM at once. They're available only when that fits
+// FRAM_IMAGE_MAX, which every 8KB part does. A larger part (the 256KB
+// Kaltstahl) is still fully readable and writable at its whole
+// capacity, buffered or not; those operations just refuse on it.
+#define FRAM_IMAGE_MAX 7680		// fram_available() on an 8KB part
+#define CRYPT_SCRATCH_SIZE (FRAM_IMAGE_MAX + 16)
 static uint8_t crypt_scratch[CRYPT_SCRATCH_SIZE];
+static uint8_t crypt_plain[FRAM_IMAGE_MAX];
+
+static bool fram_fits_in_ram(void) {
+	return fram_available() <= FRAM_IMAGE_MAX;
+}
 
-static const uint8_t crypt_aad[4] = { 0x00, 0x00, 0x00, 0x01 };
+// LTSF v0's fixed AAD -- only ever used now to decrypt a v0 image
+// once, for migration (see storage_crypt_unlock())
+static const uint8_t crypt_aad_v0[4] = { 0x00, 0x00, 0x00, 0x01 };
 
 // ---- raw (unbuffered) access -- the only functions that ever touch
 // the real backends. Used internally, and by storage_read/storage_write
@@ -300,8 +558,9 @@ static const uint8_t crypt_aad[4] = { 0x00, 0x00, 0x00, 0x01 };
 static uint32_t storage_read_raw(file_ref_t f, uint32_t offset, char *buf, uint32_t len) {
 
 	if (f.kind == STORAGE_FRAM) {
-		if (offset >= FRAM_AVAILABLE) return 0;
-		if (offset + len > FRAM_AVAILABLE) len = FRAM_AVAILABLE - offset;
+		uint32_t avail = fram_available();
+		if (offset >= avail) return 0;
+		if (len > avail - offset) len = avail - offset;
 		fram_read(buf, (int)offset, (int)len);
 		return len;
 	}
@@ -321,8 +580,8 @@ static uint32_t storage_read_raw(file_ref_t f, uint32_t offset, char *buf, uint3
 static bool storage_write_raw(file_ref_t f, uint32_t offset, char c) {
 
 	if (f.kind == STORAGE_FRAM) {
-		if (offset >= FRAM_AVAILABLE) return false;
-		fram_write((int)offset, (unsigned char)c);
+		if (offset >= fram_available()) return false;
+		fram_write_behind((int)offset, (unsigned char)c);	// core0 writes it out
 		return true;
 	}
 
@@ -332,7 +591,245 @@ static bool storage_write_raw(file_ref_t f, uint32_t offset, char c) {
 		return true;
 	}
 
-	return false;	// flash is never writable byte-at-a-time
+	return false;	// flash takes no single-byte writes: each in-place
+					// update rewrites the file from that byte to its
+					// end, so edits go through storage_write_range()
+					// or buffer mode, batched into one update
+
+}
+
+// range counterpart to storage_write_raw(), for the whole-buffer
+// writers below (commit, encrypt/decrypt, password rotation) -- FRAM
+// goes out as a single fram_write_range() burst rather than one SPI
+// transaction per byte. All-or-nothing bounds check, same as the
+// per-byte loops this replaces would have failed on their first
+// out-of-range byte.
+static bool storage_write_raw_range(file_ref_t f, uint32_t offset,
+		const uint8_t *buf, uint32_t len) {
+
+	if (f.kind == STORAGE_FRAM) {
+		uint32_t avail = fram_available();
+		if (offset > avail || len > avail - offset) return false;
+		fram_write_range((int)offset, buf, (int)len);
+		return true;
+	}
+
+	if (f.kind == STORAGE_SRAM) {
+		if (offset > SRAM_DISK_SIZE || len > SRAM_DISK_SIZE - offset) return false;
+		memcpy(&sram_disk[offset], buf, len);
+		return true;
+	}
+
+	return false;
+
+}
+
+// ---- LTSF v1: per-sector encryption ----
+//
+// Each sector is its own ChaCha20-Poly1305 message. Nonce: sector index
+// (u32 LE) in bytes 0-3, LTSF_VERSION_SECTORED (u32 LE) in bytes 4-7,
+// the sector's counter (u32 LE) in bytes 8-11 -- unique per (sector,
+// re-encryption) under one key. The middle word keeps every v1 nonce
+// disjoint from anything v0 could have used (v0 started from all-zero
+// and only ever incremented, so its middle word stays 0 for the first
+// 2^32 commits) -- which matters, because v0 migration re-encrypts
+// under the SAME key. The AAD binds each sector to its format and
+// position, so a sector copied over another fails authentication
+// rather than decrypting into the wrong place.
+
+static void ltsf_sector_nonce(uint32_t idx, uint32_t counter, uint8_t nonce[12]) {
+	uint32_t ver = LTSF_VERSION_SECTORED;
+	memcpy(&nonce[0], &idx, 4);
+	memcpy(&nonce[4], &ver, 4);
+	memcpy(&nonce[8], &counter, 4);
+}
+
+static void ltsf_sector_aad(uint32_t idx, uint8_t aad[4]) {
+	aad[0] = LTSF_VERSION_SECTORED;
+	aad[1] = LTSF_ALGO_SHA256_CHACHA20_POLY1305;
+	aad[2] = (uint8_t)(idx >> 8);
+	aad[3] = (uint8_t)idx;
+}
+
+// decrypts sector idx straight from FRAM into pt (room for the
+// sector's length). False if its tag doesn't verify.
+static bool ltsf_open_sector(psa_key_id_t key, uint32_t idx, uint8_t *pt) {
+
+	uint32_t off, len;
+	ltsf_sector_span(idx, &off, &len);
+	if (len + 16 > sizeof(crypt_scratch)) return false;
+
+	uint32_t got = storage_read_raw(storage_fram_ref(), off, (char *)crypt_scratch, len);
+	if (got != len) return false;
+	memcpy(&crypt_scratch[len], sectors[idx].tag, 16);
+
+	uint8_t nonce[12], aad[4];
+	ltsf_sector_nonce(idx, sectors[idx].counter, nonce);
+	ltsf_sector_aad(idx, aad);
+
+	size_t pt_len = 0;
+	if (!crypt_decrypt(key, nonce, aad, crypt_scratch, len + 16,
+			pt, len, &pt_len))
+		return false;
+	return pt_len == len;
+
+}
+
+// encrypts pt as the next version of sector idx into ct (room for the
+// sector's length + 16) and advances sectors[idx] to match -- but
+// writes nothing to FRAM; callers decide when ciphertext and table
+// record land.
+static bool ltsf_seal_sector(psa_key_id_t key, uint32_t idx, const uint8_t *pt, uint8_t *ct) {
+
+	uint32_t off, len;
+	ltsf_sector_span(idx, &off, &len);
+
+	if (sectors[idx].counter == UINT32_MAX) return false;	// never reuse a nonce
+	uint32_t counter = sectors[idx].counter + 1;
+
+	uint8_t nonce[12], aad[4];
+	ltsf_sector_nonce(idx, counter, nonce);
+	ltsf_sector_aad(idx, aad);
+
+	size_t ct_len = 0;
+	if (!crypt_encrypt(key, nonce, aad, pt, len, ct, len + 16, &ct_len))
+		return false;
+	if (ct_len != len + 16) return false;
+
+	sectors[idx].counter = counter;
+	memcpy(sectors[idx].tag, &ct[len], 16);
+	return true;
+
+}
+
+// buffer commit path: re-encrypts one sector and writes it back --
+// ciphertext first, then its table record.
+static bool ltsf_commit_sector(psa_key_id_t key, uint32_t idx, const uint8_t *pt) {
+
+	uint32_t off, len;
+	ltsf_sector_span(idx, &off, &len);
+	if (len + 16 > sizeof(crypt_scratch)) return false;
+
+	ltsf_sector_t prev = sectors[idx];
+	if (!ltsf_seal_sector(key, idx, pt, crypt_scratch) ||
+			!storage_write_raw_range(storage_fram_ref(), off, crypt_scratch, len)) {
+		sectors[idx] = prev;
+		return false;
+	}
+
+	ltsf_save_sector(idx);
+	return true;
+
+}
+
+// seals a whole plaintext image (fram_available() bytes) as a fresh v1
+// layout under key, for enable, password change and v0 migration --
+// each of which either uses a brand-new key or, for migration, a nonce
+// space v0 never touched, so every counter restarts from zero. All of
+// the ciphertext is produced into crypt_scratch before anything is
+// written (each sector's tag lands where the next sector's ciphertext
+// is about to go, and is copied out before that happens), so the
+// window in which FRAM holds a mix of old and new content is only the
+// write itself, never the much slower encryption. Updates the
+// header's geometry in RAM; the caller saves the header once its own
+// fields (salt, algo...) are set too.
+static bool ltsf_seal_image(psa_key_id_t key, const uint8_t *pt) {
+
+	uint32_t avail = fram_available();
+	if (avail + 16 > sizeof(crypt_scratch)) return false;
+
+	uint16_t prev_units = meta.sector_units;
+	uint8_t prev_count = meta.sector_count;
+	static ltsf_sector_t prev[LTSF_MAX_SECTORS];
+	memcpy(prev, sectors, sizeof(prev));
+
+	ltsf_sector_geometry(avail, &meta.sector_units, &meta.sector_count);
+
+	for (uint32_t i = 0; i < meta.sector_count; i++) {
+		uint32_t off, len;
+		ltsf_sector_span(i, &off, &len);
+		sectors[i].counter = 0;
+		if (!ltsf_seal_sector(key, i, &pt[off], &crypt_scratch[off])) {
+			meta.sector_units = prev_units;
+			meta.sector_count = prev_count;
+			memcpy(sectors, prev, sizeof(prev));
+			return false;
+		}
+	}
+
+	if (!storage_write_raw_range(storage_fram_ref(), 0, crypt_scratch, avail))
+		return false;
+	for (uint32_t i = 0; i < meta.sector_count; i++)
+		ltsf_save_sector(i);
+
+	meta.version = LTSF_VERSION_SECTORED;
+	memset(meta.nonce, 0, sizeof(meta.nonce));	// v0-only fields
+	memset(meta.tag, 0, sizeof(meta.tag));
+	return true;
+
+}
+
+// decrypts every sector into pt (fram_available() bytes) -- password
+// change and disable, which need the whole plaintext regardless
+static bool ltsf_open_image(psa_key_id_t key, uint8_t *pt) {
+	for (uint32_t i = 0; i < meta.sector_count; i++) {
+		uint32_t off, len;
+		ltsf_sector_span(i, &off, &len);
+		if (!ltsf_open_sector(key, i, &pt[off])) return false;
+	}
+	return true;
+}
+
+// ---- buffer pages <-> backend ----
+
+static bool buffer_encrypted(const write_buffer_t *b) {
+	return b->kind == STORAGE_FRAM && storage_crypt_status() == CRYPT_UNLOCKED;
+}
+
+// fills dst with page page_no's current backend content, as plaintext
+// (zero past the end of the file). Encrypted FRAM decrypts the sector
+// the page sits in -- sectors are whole multiples of LTSF_SECTOR_UNIT,
+// so a page never straddles two.
+static bool page_load(write_buffer_t *b, uint32_t page_no, uint8_t *dst) {
+
+	uint32_t off = page_no * BUFFER_PAGE;
+	memset(dst, 0, BUFFER_PAGE);
+	if (off >= b->len) return true;
+
+	uint32_t n = b->len - off;
+	if (n > BUFFER_PAGE) n = BUFFER_PAGE;
+
+	if (!buffer_encrypted(b))
+		return storage_read_raw(b->file, off, (char *)dst, n) == n;
+
+	uint32_t idx = off / ltsf_sector_bytes();
+	uint32_t soff, slen;
+	if (idx >= meta.sector_count) return false;
+	ltsf_sector_span(idx, &soff, &slen);
+	if (!ltsf_open_sector(key_id, idx, crypt_plain)) return false;
+	memcpy(dst, &crypt_plain[off - soff], n);
+	return true;
+
+}
+
+// the page to satisfy a read from, if there is one: a page already in
+// the pool, or for encrypted FRAM a freshly decrypted one (kept, clean,
+// so paging around doesn't decrypt a sector once per row). NULL with
+// *err clear means read straight from the backend -- plaintext pages
+// that were never written aren't worth a copy.
+static buffer_page_t *page_for_read(write_buffer_t *b, uint32_t page_no, bool *err) {
+
+	buffer_page_t *pg = page_find(b, page_no);
+	if (pg || !buffer_encrypted(b)) return pg;
+
+	pg = page_alloc(b, page_no);
+	if (!pg) { *err = true; return NULL; }
+	if (!page_load(b, page_no, pg->data)) {
+		page_free(b, pg);
+		*err = true;
+		return NULL;
+	}
+	return pg;
 
 }
 
@@ -340,13 +837,41 @@ static bool storage_write_raw(file_ref_t f, uint32_t offset, char c) {
 
 uint32_t storage_read(file_ref_t f, uint32_t offset, char *buf, uint32_t len) {
 
-	write_buffer_t *b = buffer_for_kind(f.kind);
+	write_buffer_t *b = buffer_for(f);
 
 	if (b && b->active) {
+
 		if (offset >= b->len) return 0;
 		if (offset + len > b->len) len = b->len - offset;
-		memcpy(buf, &b->data[offset], len);
+
+		// page by page: from the overlay where a page is materialized,
+		// straight from the backend where it isn't
+		uint32_t done = 0;
+		while (done < len) {
+			uint32_t pos = offset + done;
+			uint32_t page_no = pos / BUFFER_PAGE;
+			uint32_t in_page = pos % BUFFER_PAGE;
+			uint32_t n = BUFFER_PAGE - in_page;
+			if (n > len - done) n = len - done;
+
+			bool err = false;
+			buffer_page_t *pg = page_for_read(b, page_no, &err);
+			if (pg) {
+				memcpy(&buf[done], &pg->data[in_page], n);
+			} else if (err && buffer_encrypted(b)) {
+				// pool full of unsaved pages -- still readable, just
+				// without keeping the decrypted page around
+				static uint8_t tmp[BUFFER_PAGE];
+				if (!page_load(b, page_no, tmp)) return 0;
+				memcpy(&buf[done], &tmp[in_page], n);
+			} else {
+				if (storage_read_raw(b->file, pos, &buf[done], n) != n) return 0;
+			}
+			done += n;
+		}
+
 		return len;
+
 	}
 
 	return storage_read_raw(f, offset, buf, len);
@@ -357,113 +882,373 @@ bool storage_write(file_ref_t f, uint32_t offset, char c) {
 
 	if (!storage_can_write(f)) return false;
 
-	write_buffer_t *b = buffer_for_kind(f.kind);
+	write_buffer_t *b = buffer_for(f);
 
 	if (b && b->active) {
+
 		if (offset >= b->len) return false;
-		b->data[offset] = (uint8_t)c;
+
+		uint32_t page_no = offset / BUFFER_PAGE;
+		buffer_page_t *pg = page_find(b, page_no);
+		if (!pg) {
+			pg = page_alloc(b, page_no);
+			if (!pg) {
+				b->full = true;
+				return false;
+			}
+			if (!page_load(b, page_no, pg->data)) {
+				page_free(b, pg);
+				return false;
+			}
+		}
+
+		// a commit's DMA may still be reading this page -- let it
+		// finish before the page changes under it
+		page_settle(pg);
+
+		uint32_t in_page = offset % BUFFER_PAGE;
+		pg->data[in_page] = (uint8_t)c;
+		pg->dirty_map |= (uint8_t)(1u << (in_page / DIRTY_CHUNK));
 		b->dirty = true;
 		return true;
+
 	}
 
 	return storage_write_raw(f, offset, c);
 
 }
 
+uint32_t storage_write_range(file_ref_t f, uint32_t offset, const char *buf, uint32_t len) {
+
+	if (!storage_can_write(f)) return 0;
+
+	write_buffer_t *b = buffer_for(f);
+
+	if (b && b->active) {
+
+		if (offset >= b->len) return 0;
+		if (len > b->len - offset) len = b->len - offset;
+
+		// page by page, one lookup each. A page the range covers
+		// completely is never loaded from the backend first -- every
+		// byte of it is about to be replaced anyway.
+		uint32_t done = 0;
+		while (done < len) {
+			uint32_t pos = offset + done;
+			uint32_t page_no = pos / BUFFER_PAGE;
+			uint32_t in_page = pos % BUFFER_PAGE;
+			uint32_t n = BUFFER_PAGE - in_page;
+			if (n > len - done) n = len - done;
+
+			buffer_page_t *pg = page_find(b, page_no);
+			if (!pg) {
+				pg = page_alloc(b, page_no);
+				if (!pg) {
+					b->full = true;
+					return done;
+				}
+				if (n < BUFFER_PAGE && !page_load(b, page_no, pg->data)) {
+					page_free(b, pg);
+					return done;
+				}
+			}
+
+			page_settle(pg);
+			memcpy(&pg->data[in_page], &buf[done], n);
+			for (uint32_t c = in_page / DIRTY_CHUNK; c * DIRTY_CHUNK < in_page + n; c++)
+				pg->dirty_map |= (uint8_t)(1u << c);
+			b->dirty = true;
+			done += n;
+		}
+
+		return len;
+
+	}
+
+	// flash: in place, clipped at the end of the file by
+	// flash_storage_write_range() itself
+	if (f.kind == STORAGE_FLASH) {
+		ensure_storage_ready();
+		return flash_storage_write_range(f.name, offset, buf, len);
+	}
+
+	if (f.kind == STORAGE_FRAM) {
+		uint32_t avail = fram_available();
+		if (offset >= avail) return 0;
+		if (len > avail - offset) len = avail - offset;
+	} else if (f.kind == STORAGE_SRAM) {
+		if (offset >= SRAM_DISK_SIZE) return 0;
+		if (len > SRAM_DISK_SIZE - offset) len = SRAM_DISK_SIZE - offset;
+	}
+
+	return storage_write_raw_range(f, offset, (const uint8_t *)buf, len) ? len : 0;
+
+}
+
+bool storage_map(file_ref_t f, uint32_t offset, const char **ptr, uint32_t *len) {
+
+	if (f.kind != STORAGE_FLASH) return false;
+
+	// unsaved edits aren't in flash yet -- storage_read() has them
+	write_buffer_t *b = buffer_for(f);
+	if (b && b->active && b->dirty) return false;
+
+	const uint8_t *p;
+	if (!flash_storage_map(f.name, offset, &p, len)) return false;
+
+	*ptr = (const char *)p;
+	return true;
+
+}
+
+uint32_t storage_read_vec(file_ref_t f, storage_seg_t *segs, int count) {
+
+	// unbuffered flash -- every segment through one handle
+	write_buffer_t *b = buffer_for(f);
+	if (f.kind == STORAGE_FLASH && !(b && b->active)) {
+		ensure_storage_ready();
+		return flash_storage_read_vec(f.name, segs, count);
+	}
+
+	uint32_t total = 0;
+	for (int i = 0; i < count; i++) {
+		segs[i].len = storage_read(f, segs[i].offset, segs[i].buf, segs[i].len);
+		total += segs[i].len;
+	}
+	return total;
+
+}
+
 // ---- buffer mode control ----
 // all operate on "the buffer for current_file.kind" -- editor.c only
 // ever asks about whatever file it's currently showing, so this stays
 // the same simple, parameterless shape it's always had. FRAM's and
 // SRAM's independence is invisible at this layer: it just falls out
-// of buffer_for_kind() picking the right one underneath.
+// of buffer_for() picking the right one underneath.
 
 bool storage_buffer_active(void) {
-	write_buffer_t *b = buffer_for_kind(current_file.kind);
+	write_buffer_t *b = buffer_for(current_file);
 	return b && b->active;
 }
 
 bool storage_buffer_dirty(void) {
-	write_buffer_t *b = buffer_for_kind(current_file.kind);
+	write_buffer_t *b = buffer_for(current_file);
 	return b && b->active && b->dirty;
 }
 
+bool storage_buffer_full(void) {
+	write_buffer_t *b = buffer_for(current_file);
+	return b && b->active && b->full;
+}
+
 bool storage_buffer_enter(void) {
 
 	write_buffer_t *b = buffer_for_kind(current_file.kind);
 	if (!b) return false;
 
+	// the flash buffer moves to a different file only if it has
+	// nothing unsaved on the one it's on
+	if (b->active && buffer_for(current_file) != b) {
+		if (b->dirty) return false;
+		b->active = false;
+	}
+
 	if (b->active) return true;
 	if (!storage_can_write(current_file)) return false;
-	if (current_file.size > WRITE_BUFFER_SIZE) return false;
 
-	if (current_file.kind == STORAGE_FRAM &&
-			storage_crypt_status() == CRYPT_UNLOCKED) {
+	// nothing to copy or decrypt up front -- pages materialize as
+	// they're written (or, for encrypted FRAM, read)
+	buffer_drop_pages(b);
+	b->file = current_file;
+	b->len = current_file.size;
+	b->active = true;
+	buffer_mark_clean(b);
 
-		uint32_t got = storage_read_raw(current_file, 0,
-			(char *)crypt_scratch, FRAM_AVAILABLE);
-		if (got != FRAM_AVAILABLE) return false;
-		memcpy(&crypt_scratch[FRAM_AVAILABLE], meta.tag, 16);
+	return true;
 
-		size_t pt_len = 0;
-		if (!crypt_decrypt(key_id, meta.nonce, crypt_aad,
-				crypt_scratch, FRAM_AVAILABLE + 16,
-				b->data, WRITE_BUFFER_SIZE, &pt_len))
+}
+
+// writes back each run of adjacent dirty chunks of one plaintext page
+// as one range -- asynchronously through fram.c's DMA queue for FRAM
+// (the page remembers the ticket, see page_settle()), a memcpy for
+// SRAM. The encrypted path works per LTSF sector instead, and flash
+// all in one go (see storage_buffer_commit()).
+static bool page_commit_dirty_runs(write_buffer_t *b, buffer_page_t *pg, bool async_fram) {
+
+	uint32_t base = pg->page_no * BUFFER_PAGE;
+	uint32_t c = 0;
+
+	while (c < BUFFER_PAGE / DIRTY_CHUNK) {
+
+		if (!(pg->dirty_map & (1u << c))) { c++; continue; }
+
+		uint32_t first = c;
+		while (c < BUFFER_PAGE / DIRTY_CHUNK && (pg->dirty_map & (1u << c))) c++;
+
+		uint32_t off = first * DIRTY_CHUNK;
+		uint32_t end = c * DIRTY_CHUNK;
+		if (base + end > b->len) end = b->len - base;
+
+		if (async_fram)
+			pg->ticket = fram_write_async((int)(base + off), &pg->data[off],
+				(int)(end - off));
+		else if (!storage_write_raw_range(b->file, base + off,
+				&pg->data[off], end - off))
 			return false;
-		if (pt_len != FRAM_AVAILABLE) return false;
 
-		b->len = (uint32_t)pt_len;
+	}
 
-	} else {
-		b->len = storage_read_raw(current_file, 0,
-			(char *)b->data, current_file.size);
+	return true;
+
+}
+
+// re-encrypts sector idx of encrypted FRAM from the buffer: its pages
+// that are in the pool, and for any that aren't, the sector's current
+// content (decrypted fresh -- a clean page may have been recycled since
+// the sector was last read)
+static bool buffer_commit_sector(write_buffer_t *b, uint32_t idx) {
+
+	uint32_t soff, slen;
+	ltsf_sector_span(idx, &soff, &slen);
+
+	bool dirty = false, complete = true;
+	for (uint32_t p = soff / BUFFER_PAGE; p * BUFFER_PAGE < soff + slen; p++) {
+		buffer_page_t *pg = page_find(b, p);
+		if (!pg) complete = false;
+		else if (pg->dirty_map) dirty = true;
 	}
+	if (!dirty) return true;
 
-	b->active = true;
-	b->dirty = false;
+	if (!complete && !ltsf_open_sector(key_id, idx, crypt_plain)) return false;
+
+	for (uint32_t p = soff / BUFFER_PAGE; p * BUFFER_PAGE < soff + slen; p++) {
+		buffer_page_t *pg = page_find(b, p);
+		if (!pg) continue;
+		uint32_t n = soff + slen - p * BUFFER_PAGE;
+		if (n > BUFFER_PAGE) n = BUFFER_PAGE;
+		memcpy(&crypt_plain[p * BUFFER_PAGE - soff], pg->data, n);
+	}
+
+	return ltsf_commit_sector(key_id, idx, crypt_plain);
+
+}
+
+// flash: every dirty page as ONE segment of one in-place write, in
+// file order -- flash_storage_write_vec() then copies the rest of the
+// file over once, however many places were edited. A segment is the
+// page from its first dirty chunk to its last: the clean chunks in
+// between already hold the file's content (a page is loaded whole
+// unless a write covered all of it), so there's no need to split runs
+// the way FRAM does. The pages are dropped afterwards rather than
+// kept as a cache: flash files change by other routes (XMODEM, SRWP,
+// te) that never pass through here, and the flash layer has its own
+// read cache anyway.
+static storage_seg_t flash_commit_segs[BUFFER_POOL_PAGES];
+
+static bool buffer_commit_flash(write_buffer_t *b) {
+
+	int n = 0;
+	for (int i = 0; i < BUFFER_POOL_PAGES; i++) {
+
+		buffer_page_t *pg = &page_pool[i];
+		if (pg->owner != (int8_t)b->kind || !pg->dirty_map) continue;
+
+		uint32_t first = __builtin_ctz(pg->dirty_map);
+		uint32_t last = 31 - __builtin_clz(pg->dirty_map);
+		storage_seg_t seg;
+		seg.offset = pg->page_no * BUFFER_PAGE + first * DIRTY_CHUNK;
+		seg.buf = (char *)&pg->data[first * DIRTY_CHUNK];
+		seg.len = (last + 1 - first) * DIRTY_CHUNK;
+		if (seg.offset >= b->len) continue;
+		if (seg.len > b->len - seg.offset) seg.len = b->len - seg.offset;
+
+		// insertion sort by offset -- a handful of pages, typically
+		int j = n++;
+		while (j > 0 && flash_commit_segs[j - 1].offset > seg.offset) {
+			flash_commit_segs[j] = flash_commit_segs[j - 1];
+			j--;
+		}
+		flash_commit_segs[j] = seg;
+
+	}
+
+	if (n == 0) return true;
+
+	uint32_t want = 0;
+	for (int i = 0; i < n; i++) want += flash_commit_segs[i].len;
 
+	ensure_storage_ready();
+	if (flash_storage_write_vec(b->file.name, flash_commit_segs, n) != want)
+		return false;
+
+	buffer_drop_pages(b);
 	return true;
 
 }
 
 bool storage_buffer_commit(void) {
 
-	write_buffer_t *b = buffer_for_kind(current_file.kind);
+	write_buffer_t *b = buffer_for(current_file);
 	if (!b || !b->active) return false;
 
-	if (current_file.kind == STORAGE_FRAM &&
-			storage_crypt_status() == CRYPT_UNLOCKED) {
-
-		crypt_nonce_inc(meta.nonce);
+	if (buffer_encrypted(b)) {
 
-		size_t ct_len = 0;
-		if (!crypt_encrypt(key_id, meta.nonce, crypt_aad,
-				b->data, b->len,
-				crypt_scratch, sizeof(crypt_scratch), &ct_len))
-			return false;
-		if (ct_len != b->len + 16) return false;
+		// re-encrypt only the sectors an edit actually touched: a
+		// one-character change costs one 512-byte seal and one
+		// 20-byte table record, not the whole image
+		if (ltsf_sector_bytes() > sizeof(crypt_plain)) return false;
+		for (uint32_t i = 0; i < meta.sector_count; i++)
+			if (!buffer_commit_sector(b, i)) return false;
 
-		for (uint32_t i = 0; i < b->len; i++)
-			if (!storage_write_raw(current_file, i, (char)crypt_scratch[i]))
-				return false;
+	} else if (b->kind == STORAGE_FLASH) {
 
-		memcpy(meta.tag, &crypt_scratch[b->len], 16);
-		ltsf_save_meta(&meta);
+		if (!buffer_commit_flash(b)) return false;
 
 	} else {
-		for (uint32_t i = 0; i < b->len; i++) {
-			if (!storage_write_raw(current_file, i, (char)b->data[i]))
-				return false;
+
+		// plaintext FRAM: queue every dirty run for DMA back to back,
+		// straight out of the pages with no copy, then wait for all of
+		// them before calling the buffer clean. The buffer only counts
+		// as committed once its bytes are on the chip -- until then a
+		// power cut has to leave the old content, not some of the
+		// new. Waiting also keeps the mirror honest: it took each run
+		// at submit time, so the page mustn't change before the DMA
+		// has read it (page_settle(), which storage_write() and
+		// storage_write_range() call too before touching a page).
+		// A DMA transfer has no way to fail once queued, so there's
+		// no error to collect here beyond the range check.
+		// The encrypted path above stays synchronous on purpose:
+		// crypt_scratch is reused by the next sector's seal, and each
+		// sector record has to land strictly after its ciphertext.
+		bool async_fram = (b->kind == STORAGE_FRAM);
+		if (async_fram && b->len > fram_available()) return false;
+
+		for (int i = 0; i < BUFFER_POOL_PAGES; i++) {
+			buffer_page_t *pg = &page_pool[i];
+			if (pg->owner != (int8_t)b->kind || !pg->dirty_map) continue;
+			if (!page_commit_dirty_runs(b, pg, async_fram)) return false;
 		}
+
+		for (int i = 0; i < BUFFER_POOL_PAGES; i++)
+			if (page_pool[i].owner == (int8_t)b->kind)
+				page_settle(&page_pool[i]);
+
 	}
 
-	b->dirty = false;
+	// durability barrier: a commit is the point the UI reports as
+	// saved, so nothing FRAM still holds queued -- write-behind bytes
+	// from before buffer mode, a transfer another path left in flight
+	// -- may still be pending when it returns
+	if (b->kind == STORAGE_FRAM) fram_flush();
+
+	buffer_mark_clean(b);
 	return true;
 
 }
 
 bool storage_buffer_exit(void) {
 
-	write_buffer_t *b = buffer_for_kind(current_file.kind);
+	write_buffer_t *b = buffer_for(current_file);
 	if (!b || !b->active) return true;
 	if (b->dirty) return false;
 
@@ -471,6 +1256,10 @@ bool storage_buffer_exit(void) {
 			storage_crypt_status() != CRYPT_PLAINTEXT)
 		return false;	// buffer mode is not optional for encrypted FRAM
 
+	if (current_file.kind == STORAGE_FLASH)
+		return false;	// nor for flash, which has no byte-at-a-time path
+
+	buffer_drop_pages(b);
 	b->active = false;
 	return true;
 
@@ -482,14 +1271,27 @@ bool storage_select(file_ref_t f) {
 
 	// each storage kind keeps its own independent buffer, so
 	// switching between FRAM and SRAM never discards anything --
-	// unlike the old single shared buffer, there's no longer anything
-	// here that can fail. Still returns bool: a stable signature for
-	// callers, in case a future failure mode is ever added.
+	// unlike the old single shared buffer, that can't fail. Flash
+	// can: its one buffer follows one file at a time, so a different
+	// flash file can't be selected while it holds unsaved edits to
+	// another.
+	if (f.kind == STORAGE_FLASH && flash_buffer.active && flash_buffer.dirty &&
+			strcmp(flash_buffer.file.name, f.name) != 0)
+		return false;
+
 	current_file = f;
 
 	if (f.kind == STORAGE_FRAM && storage_crypt_status() == CRYPT_UNLOCKED)
 		storage_buffer_enter();	// no-op if FRAM's buffer is already active
 
+	// flash is only ever edited through the buffer, so it's entered
+	// on selection -- afresh unless it has unsaved edits to this file,
+	// since the file may have been rewritten since it was last here
+	if (f.kind == STORAGE_FLASH) {
+		if (!flash_buffer.dirty) flash_buffer.active = false;
+		storage_buffer_enter();
+	}
+
 	return true;
 
 }
@@ -533,6 +1335,9 @@ static bool generate_new_salt(uint8_t salt_out[16]) {
 
 bool storage_crypt_enable(const char *password) {
 
+	uint32_t avail = fram_available();
+	if (!fram_fits_in_ram()) return false;
+
 	ensure_meta_loaded();
 
 	if (meta.algo != LTSF_ALGO_PLAINTEXT) return false;
@@ -552,28 +1357,14 @@ bool storage_crypt_enable(const char *password) {
 	if (!crypt_init(&new_key_id, derived_key)) return false;
 
 	file_ref_t fram = storage_fram_ref();
-	static uint8_t plaintext[FRAM_AVAILABLE];
-	uint32_t got = storage_read_raw(fram, 0, (char *)plaintext, FRAM_AVAILABLE);
-	if (got != FRAM_AVAILABLE) return false;
-
-	uint8_t new_nonce[12];
-	memset(new_nonce, 0, 12);
+	uint8_t *plaintext = crypt_plain;
+	uint32_t got = storage_read_raw(fram, 0, (char *)plaintext, avail);
+	if (got != avail) return false;
 
-	size_t ct_len = 0;
-	if (!crypt_encrypt(new_key_id, new_nonce, crypt_aad,
-			plaintext, FRAM_AVAILABLE,
-			crypt_scratch, sizeof(crypt_scratch), &ct_len))
-		return false;
-	if (ct_len != FRAM_AVAILABLE + 16) return false;
-
-	for (uint32_t i = 0; i < FRAM_AVAILABLE; i++)
-		if (!storage_write_raw(fram, i, (char)crypt_scratch[i])) return false;
+	if (!ltsf_seal_image(new_key_id, plaintext)) return false;
 
 	memcpy(meta.salt, new_salt, 16);
-	memcpy(meta.nonce, new_nonce, 12);
-	memcpy(meta.tag, &crypt_scratch[FRAM_AVAILABLE], 16);
 	meta.magic = LTSF_MAGIC;
-	meta.version = 0;
 	meta.algo = LTSF_ALGO_SHA256_CHACHA20_POLY1305;
 	strncpy((char *)meta.plaindesc, "SHA256(p||salt)+ChaCha20-Poly1305",
 		sizeof(meta.plaindesc) - 1);
@@ -597,6 +1388,9 @@ bool storage_crypt_enable(const char *password) {
 
 bool storage_crypt_unlock(const char *password) {
 
+	uint32_t avail = fram_available();
+	if (!fram_fits_in_ram()) return false;
+
 	ensure_meta_loaded();
 
 	if (meta.algo == LTSF_ALGO_PLAINTEXT) return false;
@@ -611,18 +1405,41 @@ bool storage_crypt_unlock(const char *password) {
 	// verify the password by attempting a real decrypt (AEAD tag
 	// check) -- this is the ONLY password verification mechanism;
 	// there is no separate stored password hash
-	file_ref_t fram = storage_fram_ref();
-	uint32_t got = storage_read_raw(fram, 0, (char *)crypt_scratch, FRAM_AVAILABLE);
-	if (got != FRAM_AVAILABLE) return false;
-	memcpy(&crypt_scratch[FRAM_AVAILABLE], meta.tag, 16);
+	uint8_t *scratch_pt = crypt_plain;
 
-	static uint8_t scratch_pt[FRAM_AVAILABLE];
-	size_t pt_len = 0;
-	if (!crypt_decrypt(new_key_id, meta.nonce, crypt_aad,
-			crypt_scratch, FRAM_AVAILABLE + 16,
-			scratch_pt, FRAM_AVAILABLE, &pt_len))
-		return false;
-	if (pt_len != FRAM_AVAILABLE) return false;
+	if (meta.version == LTSF_VERSION_WHOLE) {
+
+		// a v0 image: decrypt it whole one last time, then migrate it
+		// to v1 under the same key, so this is the last unlock that
+		// pays for a whole-image decrypt. Same exposure as any v0
+		// commit if power fails mid-write (it was never crash-atomic
+		// either) -- the header is only flipped to v1 once every
+		// sector and record has landed.
+		file_ref_t fram = storage_fram_ref();
+		uint32_t got = storage_read_raw(fram, 0, (char *)crypt_scratch, avail);
+		if (got != avail) return false;
+		memcpy(&crypt_scratch[avail], meta.tag, 16);
+
+		size_t pt_len = 0;
+		if (!crypt_decrypt(new_key_id, meta.nonce, crypt_aad_v0,
+				crypt_scratch, avail + 16,
+				scratch_pt, avail, &pt_len))
+			return false;
+		if (pt_len != avail) return false;
+
+		if (!ltsf_seal_image(new_key_id, scratch_pt)) return false;
+		ltsf_save_meta(&meta);
+
+	} else {
+
+		// v1: sector 0 alone proves the key -- the rest are only
+		// decrypted once something actually reads them
+		uint32_t off, len;
+		ltsf_sector_span(0, &off, &len);
+		if (meta.sector_count == 0 || len > sizeof(crypt_plain)) return false;
+		if (!ltsf_open_sector(new_key_id, 0, scratch_pt)) return false;
+
+	}
 
 	key_id = new_key_id;
 	crypt_valid = true;
@@ -635,6 +1452,8 @@ bool storage_crypt_unlock(const char *password) {
 
 bool storage_crypt_change_password(const char *new_password) {
 
+	if (!fram_fits_in_ram()) return false;
+
 	if (storage_crypt_status() != CRYPT_UNLOCKED) return false;
 	if (!new_password || !new_password[0]) return false;
 
@@ -647,18 +1466,8 @@ bool storage_crypt_change_password(const char *new_password) {
 	// (matches storage_crypt_disable()'s own pattern). The plaintext
 	// this produces only ever lives in this local RAM buffer -- it is
 	// never written to FRAM or flash at any point during rotation.
-	file_ref_t fram = storage_fram_ref();
-	uint32_t got = storage_read_raw(fram, 0, (char *)crypt_scratch, FRAM_AVAILABLE);
-	if (got != FRAM_AVAILABLE) return false;
-	memcpy(&crypt_scratch[FRAM_AVAILABLE], meta.tag, 16);
-
-	static uint8_t plaintext[FRAM_AVAILABLE];
-	size_t pt_len = 0;
-	if (!crypt_decrypt(key_id, meta.nonce, crypt_aad,
-			crypt_scratch, FRAM_AVAILABLE + 16,
-			plaintext, FRAM_AVAILABLE, &pt_len))
-		return false;
-	if (pt_len != FRAM_AVAILABLE) return false;
+	uint8_t *plaintext = crypt_plain;
+	if (!ltsf_open_image(key_id, plaintext)) return false;
 
 	// derive a NEW key from a genuinely fresh salt (same generation
 	// as enabling encryption from scratch)
@@ -671,39 +1480,21 @@ bool storage_crypt_change_password(const char *new_password) {
 	psa_key_id_t new_key_id;
 	if (!crypt_init(&new_key_id, derived_key)) return false;
 
-	uint8_t new_nonce[12];
-	memset(new_nonce, 0, 12);
-
 	// re-encrypt the SAME plaintext with the new key -- straight back
 	// to FRAM as ciphertext, still never touching flash/FRAM in
-	// plaintext form
-	size_t ct_len = 0;
-	if (!crypt_encrypt(new_key_id, new_nonce, crypt_aad,
-			plaintext, FRAM_AVAILABLE,
-			crypt_scratch, sizeof(crypt_scratch), &ct_len))
-		return false;
-	if (ct_len != FRAM_AVAILABLE + 16) return false;
-
-	for (uint32_t i = 0; i < FRAM_AVAILABLE; i++)
-		if (!storage_write_raw(fram, i, (char)crypt_scratch[i])) return false;
+	// plaintext form. A new key means every sector counter can
+	// restart.
+	if (!ltsf_seal_image(new_key_id, plaintext)) return false;
 
 	memcpy(meta.salt, new_salt, 16);
-	memcpy(meta.nonce, new_nonce, 12);
-	memcpy(meta.tag, &crypt_scratch[FRAM_AVAILABLE], 16);
 	ltsf_save_meta(&meta);
 
 	key_id = new_key_id;
 	// crypt_valid stays true -- still unlocked, just re-keyed
 
-	// content is unchanged (only the key changed), but refresh FRAM's
-	// buffer specifically (not "whatever current_file.kind happens to
-	// be" -- FRAM's buffer can be active while SRAM is currently
-	// selected) if it was active, so nothing stale lingers
-	if (fram_buffer.active) {
-		fram_buffer.len = FRAM_AVAILABLE;
-		memcpy(fram_buffer.data, plaintext, FRAM_AVAILABLE);
-		fram_buffer.dirty = false;
-	}
+	// content is unchanged (only the key changed), so FRAM's buffer
+	// pages -- plaintext, and all clean, checked above -- stay valid
+	// as they are
 
 	return true;
 
@@ -711,29 +1502,25 @@ bool storage_crypt_change_password(const char *new_password) {
 
 bool storage_crypt_disable(void) {
 
+	uint32_t avail = fram_available();
+	if (!fram_fits_in_ram()) return false;
+
 	if (storage_crypt_status() != CRYPT_UNLOCKED) return false;
 
 	// this reads RAW FRAM below, bypassing any buffer -- refuse rather
 	// than silently discarding unsaved edits sitting in a dirty buffer
 	if (fram_buffer.active && fram_buffer.dirty) return false;
 
-	file_ref_t fram = storage_fram_ref();
-	uint32_t got = storage_read_raw(fram, 0, (char *)crypt_scratch, FRAM_AVAILABLE);
-	if (got != FRAM_AVAILABLE) return false;
-	memcpy(&crypt_scratch[FRAM_AVAILABLE], meta.tag, 16);
+	uint8_t *plaintext = crypt_plain;
+	if (!ltsf_open_image(key_id, plaintext)) return false;
 
-	static uint8_t plaintext[FRAM_AVAILABLE];
-	size_t pt_len = 0;
-	if (!crypt_decrypt(key_id, meta.nonce, crypt_aad,
-			crypt_scratch, FRAM_AVAILABLE + 16,
-			plaintext, FRAM_AVAILABLE, &pt_len))
-		return false;
-	if (pt_len != FRAM_AVAILABLE) return false;
-
-	for (uint32_t i = 0; i < FRAM_AVAILABLE; i++)
-		if (!storage_write_raw(fram, i, (char)plaintext[i])) return false;
+	file_ref_t fram = storage_fram_ref();
+	if (!storage_write_raw_range(fram, 0, plaintext, avail)) return false;
 
 	meta.algo = LTSF_ALGO_PLAINTEXT;
+	meta.version = LTSF_VERSION_WHOLE;
+	meta.sector_units = 0;
+	meta.sector_count = 0;
 	strncpy((char *)meta.plaindesc, "plaintext", sizeof(meta.plaindesc) - 1);
 	ltsf_save_meta(&meta);
 
@@ -744,9 +1531,8 @@ bool storage_crypt_disable(void) {
 	// while SRAM is currently selected) to match what's now on disk,
 	// if it was active
 	if (fram_buffer.active) {
-		fram_buffer.len = FRAM_AVAILABLE;
-		memcpy(fram_buffer.data, plaintext, FRAM_AVAILABLE);
-		fram_buffer.dirty = false;
+		buffer_drop_pages(&fram_buffer);
+		buffer_mark_clean(&fram_buffer);
 	}
 
 	return true;
@@ -757,19 +1543,33 @@ bool storage_crypt_disable(void) {
 
 bool storage_snapshot_fram(void) {
 
+	uint32_t avail = fram_available();
+
+	fram_flush();	// the snapshot is of what's durably on the chip
+
 	// deliberately storage_read_raw(), not storage_read() -- a
 	// snapshot captures what's actually durably stored in FRAM, which
 	// is ciphertext if FRAM is encrypted. This never decrypts for a
 	// snapshot, on purpose: flash is unencrypted storage, so leaking
 	// plaintext there would defeat the point of encrypting FRAM at all.
-	static char buf[FRAM_AVAILABLE];
-
+	// Streamed a chunk at a time, so any size of part can be
+	// snapshotted, not just one whose image fits in RAM.
+	char buf[256];
 	file_ref_t fram = storage_fram_ref();
-	uint32_t got = storage_read_raw(fram, 0, buf, FRAM_AVAILABLE);
-	if (got != FRAM_AVAILABLE) return false;
 
-	ensure_storage_ready();
-	return flash_storage_write_file("fram_snapshot.bin", buf, FRAM_AVAILABLE);
+	if (!storage_flash_stream_open("fram_snapshot.bin")) return false;
+
+	for (uint32_t off = 0; off < avail; off += sizeof(buf)) {
+		uint32_t n = avail - off;
+		if (n > sizeof(buf)) n = sizeof(buf);
+		if (storage_read_raw(fram, off, buf, n) != n ||
+				!storage_flash_stream_append(buf, n)) {
+			storage_flash_stream_abort();
+			return false;
+		}
+	}
+
+	return storage_flash_stream_close();
 
 }
 
@@ -4,21 +4,34 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "flash_storage.h"
+
 /*
  * Unified storage interface. FRAM and SRAM are both real, always-on,
  * always-writable backends (FRAM's writability additionally depends on
  * encryption lock state -- see below). Flash is real too, via
- * flash_storage.c's littlefs backend, but view-only from every editing
- * mode -- there is no per-byte flash write path, only the whole-file
- * snapshot/upload path.
+ * flash_storage.c's littlefs backend, and writable two ways: the
+ * streaming (whole-file, start to end) path the snapshot, te and
+ * XMODEM upload use, and in-place range updates
+ * (storage_write_range(), and buffer mode's commit) for editing bytes
+ * of an existing file. A range update never grows or shrinks the file,
+ * and costs a rewrite of everything from the first changed byte to the
+ * end of the file -- so there's still no per-byte write: the grid
+ * editor only edits flash through buffer mode, which turns any number
+ * of edits into one update at commit.
  *
  * FRAM encryption: ChaCha20-Poly1305 (via crypt.c/mbedtls PSA), applied
  * only to FRAM -- SRAM is ephemeral (lost on power-cycle) so there is
- * nothing durable to protect, and flash is never writable at all.
+ * nothing durable to protect, and flash files are outside the LTSF
+ * image entirely.
  * Encryption is inseparable from buffer mode: AEAD ciphers authenticate
- * the whole message in one pass, so there is no way to edit a single
+ * a whole message in one pass, so there is no way to edit a single
  * byte in place without re-processing (and re-authenticating) the
- * entire content -- buffer mode for encrypted FRAM is therefore
+ * message it sits in. LTSF v1 (see ltsf.h) keeps that message small --
+ * one sector, 512 bytes on an 8KB part -- so the buffer decrypts
+ * sectors lazily as they're touched and a commit re-encrypts only the
+ * dirty ones; v0 images are migrated to v1 on first unlock. Buffer
+ * mode for encrypted FRAM is nonetheless
  * mandatory, not optional (storage_buffer_exit() refuses while FRAM is
  * encrypted, matching the reference machdyne/blaustahl encryption
  * branch's behavior). Password entry itself is a CLI concern
@@ -27,9 +40,17 @@
  *
  * Buffer mode is a global, backend-agnostic write policy: instead of
  * writing each keystroke straight to the backend, edits accumulate in
- * one shared RAM buffer and are committed as a whole via
- * storage_buffer_commit(). It applies to whichever file is currently
- * writable (FRAM or SRAM).
+ * RAM pages overlaid on the file and are committed via
+ * storage_buffer_commit() -- which writes back only the parts that
+ * actually changed, and returns once they're durably on the backend
+ * (for FRAM, after fram_flush()). Entering it copies nothing, so it
+ * works the same on any size of part. It applies to whichever file
+ * is currently writable (FRAM or SRAM), and is the only way the grid
+ * editor writes a flash file: entered on selecting one
+ * (storage_select()), it turns edits anywhere in the file into one
+ * in-place update at commit (see flash_storage_write_range()) --
+ * never a stream-and-rename whole-file rewrite, though the update
+ * still rewrites the file from its first changed byte to its end.
  */
 
 #define STORAGE_NAME_LEN 32
@@ -88,6 +109,10 @@ void storage_board_unique_id(char *out, int out_len);
 // true if a flash file with this exact name exists.
 bool storage_flash_file_exists(const char *name);
 
+// looks a flash file up by name, from the directory index: fills *out
+// (index, name, size) and returns true, or false if it doesn't exist.
+bool storage_flash_find(const char *name, file_ref_t *out);
+
 // renames a flash file. Fails if old_name doesn't exist. Silently
 // replaces new_name if it already exists (this is littlefs's own
 // behavior) -- callers that want to warn/confirm before overwriting
@@ -97,11 +122,26 @@ bool storage_flash_rename(const char *old_name, const char *new_name);
 // deletes a flash file. False if it didn't exist.
 bool storage_flash_delete(const char *name);
 
+// one short step of idle-time flash maintenance (see
+// flash_storage_idle()), cut short as soon as input_pending() says
+// true; false when there's nothing left to do. A no-op until
+// something has actually mounted flash.
+bool storage_idle(bool (*input_pending)(void));
+
+// writes a flash file start to end, a piece at a time -- see
+// flash_storage_stream_open(). Nothing replaces `name` until close
+// succeeds.
+bool storage_flash_stream_open(const char *name);
+bool storage_flash_stream_append(const char *data, uint32_t len);
+bool storage_flash_stream_truncate(uint32_t len);
+bool storage_flash_stream_close(void);
+void storage_flash_stream_abort(void);
+
 // the globally selected "current file", shared across every mode.
-// Returns false (refuses) if buffer mode is active with unsaved
-// changes -- commit (storage_buffer_commit) or cleanly exit
-// (storage_buffer_exit) first. Switching TO unlocked encrypted FRAM
-// automatically (re-)enters buffer mode, decrypting as it does.
+// Returns false (refuses) only for a flash file while the flash buffer
+// holds unsaved edits to a different one -- commit
+// (storage_buffer_commit) first. Switching TO unlocked encrypted FRAM,
+// or to any flash file, automatically (re-)enters buffer mode.
 extern file_ref_t current_file;
 bool storage_select(file_ref_t f);
 
@@ -111,19 +151,42 @@ bool storage_select(file_ref_t f);
 uint32_t storage_read(file_ref_t f, uint32_t offset, char *buf, uint32_t len);
 bool storage_write(file_ref_t f, uint32_t offset, char c);
 
+// bulk counterparts, same redirect rules: one call per range instead
+// of one per byte, with each backend's own fast path underneath
+// (a burst for FRAM, memcpy for SRAM and the buffer, a single open
+// handle for flash). storage_write_range() clips at the end of the
+// file and returns the bytes actually written -- fewer than asked only
+// at end of file or if buffer mode runs out of pages part-way
+// (storage_buffer_full()). storage_read_vec() fills every segment,
+// updating each one's len to what it got, and returns the total.
+typedef flash_seg_t storage_seg_t;
+uint32_t storage_write_range(file_ref_t f, uint32_t offset, const char *buf, uint32_t len);
+uint32_t storage_read_vec(file_ref_t f, storage_seg_t *segs, int count);
+
+// zero-copy read: *ptr points straight at f's bytes from offset, *len
+// of them -- flash files only, see flash_storage_map() for the rules
+// (use at once; false means storage_read() instead). Always false for
+// FRAM and SRAM, and for a flash file with unsaved buffered edits.
+bool storage_map(file_ref_t f, uint32_t offset, const char **ptr, uint32_t *len);
+
 // true for SRAM always; true for FRAM unless it's encrypted and not
 // yet unlocked this session (storage_crypt_status() == CRYPT_LOCKED);
-// false for flash always.
+// true for flash, but only ranges are ever written there --
+// storage_write() of a single byte succeeds only through buffer mode.
 bool storage_can_write(file_ref_t f);
 
 // buffer mode
 bool storage_buffer_active(void);
 bool storage_buffer_dirty(void);		// true only while active AND unsaved
+bool storage_buffer_full(void);		// true once a write was refused because
+										// every buffer page holds unsaved
+										// edits -- until the next commit
 bool storage_buffer_enter(void);		// false if current_file isn't writable
 bool storage_buffer_commit(void);		// false on write failure; stays active
 bool storage_buffer_exit(void);		// false (refuses) if dirty, or if
-										// current_file is encrypted FRAM
-										// (buffer mode isn't optional there)
+										// current_file is encrypted FRAM or
+										// flash (buffer mode isn't optional
+										// there)
 
 // ---- FRAM encryption ----
 
@@ -143,7 +206,7 @@ bool storage_crypt_enable(const char *password);
 
 // attempt to unlock already-encrypted FRAM with `password`. False if
 // the password is wrong (AEAD tag check fails) or FRAM isn't
-// encrypted at all.
+// encrypted at all. A v0 image is rewritten as v1 on success.
 bool storage_crypt_unlock(const char *password);
 
 // changes the password on already-unlocked, encrypted FRAM: decrypts
@@ -85,9 +85,20 @@ char *fs_mallocfile(char *filename) {
 
 }
 
+// te hands over the whole document, already in its own buffer --
+// streamed to a temp file and renamed over the original only once it's
+// all written, so a failed save never leaves a half-written file behind
 int fs_write_file(char *filename, char *buf, int len) {
-	if (!flash_storage_write_file(filename, buf, (uint32_t)len)) return 0;
-	return len;
+
+	if (!flash_storage_stream_open(filename)) return 0;
+
+	if (!flash_storage_stream_append(buf, (uint32_t)len)) {
+		flash_storage_stream_abort();
+		return 0;
+	}
+
+	return flash_storage_stream_close() ? len : 0;
+
 }
 
 // the single, shared getch() implementation for BOTH te.c and ms.c
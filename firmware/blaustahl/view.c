@@ -1,16 +1,22 @@
 /*
  * Streaming file viewer for Blaustahl -- the flash-file counterpart
- * to the grid editor (FRAM/SRAM only). Flash files can be arbitrarily
- * large, so this scrolls one REAL LINE at a time and never loads more
- * than a screen's worth of content into memory. Always read-only --
- * flash files are edited with `te` (CLI), never here.
+ * to the grid editor. Flash files can be arbitrarily large, so this
+ * scrolls one REAL LINE at a time and never loads more than a
+ * screen's worth of content into memory. Read-only itself -- flash
+ * files are edited with `te` (CLI), or in the grid editor's HEX
+ * render, which CTRL-E hands the file over to at the current
+ * position. The grid editor's edits to a flash file collect in its
+ * buffer and land as one in-place update at commit, which rewrites
+ * the file from the first changed byte to its end (see
+ * flash_storage_write_range()).
  *
  * Tracks its own file reference (view_file) rather than sharing
  * editor.c's current_file -- the two are deliberately independent, so
  * switching back and forth between EDIT and VIEW via the menu
  * preserves each one's own position rather than one clobbering the
- * other. current_file remains dedicated to whichever of FRAM/SRAM the
- * grid editor is currently on.
+ * other. current_file remains dedicated to whichever file the grid
+ * editor is currently on -- FRAM or SRAM, unless CTRL-E made it this
+ * one.
  *
  * Line-boundary algorithm: a display line ends either at a real 0x0A
  * or after COLS (80) printed characters, whichever comes first
@@ -105,6 +111,26 @@ static bool in_selection(long offset) {
 	return offset >= lo && offset < hi;
 }
 
+// the (up to) `want` bytes at offset: pointed at straight in flash
+// when the file is mapped there that far (see storage_map()), copied
+// into buf otherwise. *got is how many there are.
+static const char *view_bytes(long offset, char *buf, uint32_t want,
+		uint32_t *got) {
+
+	const char *p;
+	uint32_t n;
+
+	if (storage_map(view_file, (uint32_t)offset, &p, &n) &&
+			(n >= want || (uint32_t)offset + n >= view_file.size)) {
+		*got = n < want ? n : want;
+		return p;
+	}
+
+	*got = storage_read(view_file, offset, buf, want);
+	return buf;
+
+}
+
 // advances from a line start to the NEXT one -- either right after a
 // real \n found within the next COLS bytes, or exactly COLS bytes
 // later (soft wrap) if none found, or short of that at EOF. If a real
@@ -113,8 +139,9 @@ static bool in_selection(long offset) {
 // the same real line).
 static long next_line_start(long offset, long *anchor) {
 
-	char buf[COLS];
-	uint32_t got = storage_read(view_file, offset, buf, COLS);
+	char tmp[COLS];
+	uint32_t got;
+	const char *buf = view_bytes(offset, tmp, COLS, &got);
 
 	for (uint32_t i = 0; i < got; i++) {
 		if (buf[i] == 0x0a) {
@@ -136,8 +163,9 @@ static long draw_one_line(long offset, int phys_row) {
 
 	printf(VT100_CURSOR_MOVE_TO, phys_row, 1);
 
-	char buf[COLS];
-	uint32_t got = storage_read(view_file, offset, buf, COLS);
+	char tmp[COLS];
+	uint32_t got;
+	const char *buf = view_bytes(offset, tmp, COLS, &got);
 
 	uint32_t i;
 	for (i = 0; i < got; i++) {
@@ -188,16 +216,17 @@ static long find_prev_real_line_anchor(long before) {
 	long limit = before - MAX_BACKSCAN;
 	if (limit < 0) limit = 0;
 
-	char buf[128];
+	char tmp[128];
 	long window_end = search_end + 1;	// exclusive
 
 	while (window_end > limit) {
 
-		long window_start = window_end - (long)sizeof(buf);
+		long window_start = window_end - (long)sizeof(tmp);
 		if (window_start < limit) window_start = limit;
 
 		uint32_t want = (uint32_t)(window_end - window_start);
-		uint32_t got = storage_read(view_file, window_start, buf, want);
+		uint32_t got;
+		const char *buf = view_bytes(window_start, tmp, want, &got);
 
 		for (int i = (int)got - 1; i >= 0; i--) {
 			if (buf[i] == 0x0a) return window_start + (long)i + 1;
@@ -391,6 +420,17 @@ void view_yield(vt100_event_t ev) {
 		return;
 	}
 
+	if (ev.type == KEY_CHAR && ev.ch == CH_ENQ) {
+		copy_mode = false;
+		if (!editor_edit_file(view_file, top_offset)) {
+			printf(VT100_CURSOR_MOVE_TO, ROWS, 1);
+			printf(VT100_ERASE_LINE);
+			printf("BLAUSTAHL -- COMMIT THE OTHER FLASH FILE'S EDITS FIRST");
+			fflush(stdout);
+		}
+		return;
+	}
+
 	if (ev.type == KEY_COPY) {
 
 		if (!copy_mode) {
@@ -4,7 +4,6 @@
  */
 
 #include <string.h>
-#include <stdlib.h>
 
 #include "pico/time.h"
 
@@ -22,16 +21,6 @@
 #define X_CTRLZ 0x1a
 
 #define XMODEM_BLOCK_SIZE 128
-// matches te's own max file size -- no reason to allow uploading a
-// file larger than what can actually be edited on-device. Dynamically
-// allocated for the duration of a single transfer (see
-// xmodem_receive_to_flash_file()) rather than reserved permanently:
-// the previous 64KB static reservation was the single largest
-// consumer of this firmware's general heap arena, competing directly
-// with the Scheme interpreter (and anything else using malloc()) even
-// though it only actually did anything during the rare moments an
-// upload was in progress.
-#define XMODEM_STAGING_SIZE (32u * 1024u)
 
 // handshake wait budget: this is a HUMAN-operated transfer, not two
 // programs starting in lockstep -- the user has to type the CLI
@@ -81,21 +70,21 @@ xmodem_result_t xmodem_receive_to_flash_file(const char *filename) {
 	// if something already mounted flash earlier this session.
 	storage_init();
 
-	// allocated fresh for this transfer, freed on every exit path
-	// below (see the cleanup: label) -- not a permanent reservation.
-	// A failed allocation here is a real, expected possibility now
-	// (competing with whatever else -- notably the Scheme
-	// interpreter -- currently has the general heap arena), not a
-	// rare edge case, so it's handled as an ordinary result code
-	// rather than left to whatever the platform's malloc() failure
-	// behavior happens to be.
-	uint8_t *staging = malloc(XMODEM_STAGING_SIZE);
-	if (!staging) return XMODEM_OUT_OF_MEMORY;
+	// each block is appended to flash as it's accepted, through the
+	// streaming writer -- nothing is staged in RAM, so an upload is
+	// limited only by free flash. The stream writes to a temp file and
+	// only replaces `filename` once the transfer has completed (see
+	// the cleanup: label -- every other exit path aborts it), so a
+	// failed or cancelled upload leaves any existing file untouched.
+	// fails before the handshake, so the sender is never engaged --
+	// most often because the one streaming writer is taken (an SRWP
+	// host mid-file, see srwp.c)
+	if (!flash_storage_stream_open(filename)) return XMODEM_OPEN_FAILED;
 
 	xmodem_result_t result;
 
 	uint32_t total = 0;
-	uint32_t last_block_size = XMODEM_BLOCK_SIZE;
+	uint32_t last_pad = 0;		// trailing CTRL-Z/NUL bytes of the last block
 	uint8_t expected_block = 1;
 
 	// establish the transfer: request CRC mode ('C'), retry until the
@@ -164,19 +153,25 @@ xmodem_result_t xmodem_receive_to_flash_file(const char *filename) {
 
 		if ((uint8_t)blk == expected_block) {
 
-			if (total + block_size > XMODEM_STAGING_SIZE) {
+			if (!flash_storage_stream_append((const char *)block_data, block_size)) {
 				cdc_putchar_reliable(X_CAN);
 				cdc_putchar_reliable(X_CAN);
 				flush_input();
-				result = XMODEM_TOO_LARGE;
+				// out of space is by far the likeliest reason
+				result = (flash_storage_free() < block_size)
+					? XMODEM_TOO_LARGE : XMODEM_WRITE_ABORTED;
 				goto cleanup;
 			}
 
-			memcpy(&staging[total], block_data, block_size);
 			total += block_size;
-			last_block_size = block_size;
 			expected_block++;
 
+			last_pad = 0;
+			while (last_pad < block_size &&
+					(block_data[block_size - 1 - last_pad] == X_CTRLZ ||
+					 block_data[block_size - 1 - last_pad] == 0x00))
+				last_pad++;
+
 		}
 		// else: (uint8_t)blk == expected_block - 1 -- a duplicate
 		// retransmit of a block we already have (our ACK was lost).
@@ -190,23 +185,19 @@ xmodem_result_t xmodem_receive_to_flash_file(const char *filename) {
 	}
 
 	// classic XMODEM pads the final block with CTRL-Z (or NUL) up to
-	// the block boundary -- trim that padding, but only ever look
-	// within the last block actually received, since 0x1A/0x00 could
-	// legitimately appear in real binary content earlier in the file
-	{
-		uint32_t trimmed = total;
-		uint32_t block_start = (total >= last_block_size) ? total - last_block_size : 0;
-
-		while (trimmed > block_start &&
-				(staging[trimmed - 1] == X_CTRLZ || staging[trimmed - 1] == 0x00))
-			trimmed--;
-
-		result = flash_storage_write_file(filename, (const char *)staging, trimmed)
-			? XMODEM_OK : XMODEM_WRITE_FAILED;
+	// the block boundary -- trim that padding, but only ever within
+	// the last block actually received, since 0x1A/0x00 could
+	// legitimately appear in real binary content earlier in the file.
+	// It's already been written by now, so it's cut back off the end.
+	if (last_pad && !flash_storage_stream_truncate(total - last_pad)) {
+		flash_storage_stream_abort();
+		return XMODEM_WRITE_FAILED;
 	}
 
+	return flash_storage_stream_close() ? XMODEM_OK : XMODEM_WRITE_FAILED;
+
 cleanup:
-	free(staging);
+	flash_storage_stream_abort();
 	return result;
 
 }
@@ -244,17 +235,33 @@ xmodem_result_t xmodem_send(file_ref_t f) {
 		uint32_t chunk = file_size - offset;
 		if (chunk > XMODEM_BLOCK_SIZE) chunk = XMODEM_BLOCK_SIZE;
 
-		uint32_t got = storage_read(f, offset, (char *)block_data, chunk);
-
-		// pad a short final block with CTRL-Z up to the full 128
-		// bytes -- classic XMODEM convention, mirrors what receive
-		// trims back off on the way in
-		for (uint32_t i = got; i < XMODEM_BLOCK_SIZE; i++)
-			block_data[i] = X_CTRLZ;
+		// a full block of a flash file is sent straight from where
+		// it sits in flash when it can be (storage_map()); anything
+		// else -- FRAM, SRAM, a block that straddles two flash blocks,
+		// the short last one -- is copied into block_data first
+		const uint8_t *data = block_data;
+		const char *mapped;
+		uint32_t mapped_len;
+		uint32_t got;
+
+		if (chunk == XMODEM_BLOCK_SIZE &&
+				storage_map(f, offset, &mapped, &mapped_len) &&
+				mapped_len >= XMODEM_BLOCK_SIZE) {
+			data = (const uint8_t *)mapped;
+			got = XMODEM_BLOCK_SIZE;
+		} else {
+			got = storage_read(f, offset, (char *)block_data, chunk);
+
+			// pad a short final block with CTRL-Z up to the full 128
+			// bytes -- classic XMODEM convention, mirrors what receive
+			// trims back off on the way in
+			for (uint32_t i = got; i < XMODEM_BLOCK_SIZE; i++)
+				block_data[i] = X_CTRLZ;
+		}
 
 		uint8_t checksum = 0;
 		for (uint32_t i = 0; i < XMODEM_BLOCK_SIZE; i++)
-			checksum = (uint8_t)(checksum + block_data[i]);
+			checksum = (uint8_t)(checksum + data[i]);
 
 		bool acked = false;
 
@@ -265,7 +272,7 @@ xmodem_result_t xmodem_send(file_ref_t f) {
 			ok = ok && cdc_putchar_reliable(block_num);
 			ok = ok && cdc_putchar_reliable((uint8_t)(255 - block_num));
 			for (uint32_t i = 0; ok && i < XMODEM_BLOCK_SIZE; i++)
-				ok = cdc_putchar_reliable(block_data[i]);
+				ok = cdc_putchar_reliable(data[i]);
 			ok = ok && cdc_putchar_reliable(checksum);
 
 			// couldn't even get the block out -- the host has stopped
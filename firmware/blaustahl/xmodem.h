@@ -32,14 +32,15 @@
 typedef enum {
 	XMODEM_OK = 0,
 	XMODEM_CANCELLED,		// sender sent CAN, or gave up retrying
-	XMODEM_TOO_LARGE,		// file exceeded the staging buffer
-	XMODEM_WRITE_FAILED,	// flash_storage_write_file() failed
+	XMODEM_TOO_LARGE,		// file ran out of free flash
+	XMODEM_WRITE_FAILED,	// (receive only) everything arrived, but
+							// finishing the file on flash failed
+	XMODEM_OPEN_FAILED,		// (receive only) the file couldn't be opened
+							// for writing -- nothing was received
+	XMODEM_WRITE_ABORTED,	// (receive only) a flash write failed
+							// mid-transfer, which was then cancelled
 	XMODEM_TIMEOUT,			// no sender ever responded to the handshake
 	XMODEM_NOT_FOUND,		// (send only) named file doesn't exist on flash
-	XMODEM_OUT_OF_MEMORY,	// (receive only) couldn't allocate the staging
-							// buffer -- see xmodem.c for why this is a
-							// real, expected possibility now, not a rare
-							// edge case
 } xmodem_result_t;
 
 xmodem_result_t xmodem_receive_to_flash_file(const char *filename);
@@ -47,7 +48,8 @@ xmodem_result_t xmodem_receive_to_flash_file(const char *filename);
 // sends `f` (FRAM, SRAM, or a flash file) to the host over XMODEM/CRC.
 // For flash files, this reads directly from the mounted filesystem
 // one block at a time rather than staging the whole file in RAM
-// first, so there's no size cap here the way there is on receive.
+// first -- receive streams the same way, so neither direction has a
+// size cap beyond free flash.
 xmodem_result_t xmodem_send(file_ref_t f);
 
 #endif
@@ -6,10 +6,30 @@
 import serial
 import logging
 import glob
+import hashlib
+import struct
+import time
+import zlib
 from serial.serialutil import SerialException
 
+# SRWP v2 (see docs/srwp.md): framed, sequence-numbered, pipelined
+SRWP_SOF = 0xa5
+CMD_TEST, CMD_READ, CMD_WRITE, CMD_SIZE = 0x00, 0x01, 0x02, 0x0a
+CMD_CRC32, CMD_SHA256, CMD_MANIFEST = 0x0b, 0x0c, 0x0d
+CMD_HELLO, CMD_BYE = 0x0e, 0x0f
+CMD_READV, CMD_WRITEV = 0x10, 0x11
+VEC_MAX = 64    # most segments in one CMD_READV/CMD_WRITEV
+CMD_FILE_LIST, CMD_FILE_STAT, CMD_FILE_READ, CMD_FILE_CREATE = 0x20, 0x21, 0x22, 0x23
+CMD_FILE_APPEND, CMD_FILE_CLOSE, CMD_FILE_RENAME, CMD_FILE_DELETE = 0x24, 0x25, 0x26, 0x27
+STATUS_NOT_FOUND = 0x08
+FILE_CHUNK = 4096    # bytes per CMD_FILE_READ/CMD_FILE_APPEND in v1
+STATUS_OK, STATUS_RANGE, STATUS_MALFORMED, STATUS_UNKNOWN = 0x00, 0x01, 0x02, 0x03
+STATUS_TOO_LONG, STATUS_FAILED, STATUS_BAD_FRAME, STATUS_BAD_SEQ = 0x04, 0x05, 0x06, 0x07
+SRWP_PURGE_SECONDS = 0.1    # twice the device's quiet time after a bad frame
+
 class BlaustahlSRWP:
     logger = logging.getLogger(__name__)
+    v2 = None    # (window, frame_max, idle seconds) once open_v2() succeeds
 
     def __init__(self, device:str|None='/dev/ttyACM0', fram_size:int|None=None):
         """
@@ -139,6 +159,217 @@ class BlaustahlSRWP:
         data = self.srwp.read(4)
         return data
 
+    def crc32_fram(self, addr:int, size:int):
+        """
+        CRC-32 (same as zlib.crc32) of `size` bytes from address `addr`, computed on the device.
+        Bytes past the end of the chip count as zeros, as in read_fram().
+        """
+        self.flush()
+
+        ba = bytearray()
+        ba.extend(b'\x00')    # Enter SRWP mode
+        ba.extend(b'\x0b')    # Command: CRC-32 of a range
+        ba.extend(addr.to_bytes(4, byteorder='little'))
+        ba.extend(size.to_bytes(4, byteorder='little'))
+
+        self.srwp.write(ba)
+        self.srwp.flush()
+
+        return int.from_bytes(self.srwp.read(4), "little")
+
+    def sha256_fram(self, addr:int, size:int):
+        """
+        SHA-256 digest (32 bytes) of `size` bytes from address `addr`, computed on the device.
+        """
+        self.flush()
+
+        ba = bytearray()
+        ba.extend(b'\x00')    # Enter SRWP mode
+        ba.extend(b'\x0c')    # Command: SHA-256 of a range
+        ba.extend(addr.to_bytes(4, byteorder='little'))
+        ba.extend(size.to_bytes(4, byteorder='little'))
+
+        self.srwp.write(ba)
+        self.srwp.flush()
+
+        return self.srwp.read(32)
+
+    def read_manifest(self, block_size:int=256):
+        """
+        CRC-32 of every `block_size` block of the chip, in order (the last one short
+        if block_size doesn't divide the chip size).
+        :param block_size: Block size in bytes, at least 64
+        :return: List of CRCs
+        """
+        self.flush()
+
+        ba = bytearray()
+        ba.extend(b'\x00')    # Enter SRWP mode
+        ba.extend(b'\x0d')    # Command: block manifest
+        ba.extend(block_size.to_bytes(4, byteorder='little'))
+
+        self.srwp.write(ba)
+        self.srwp.flush()
+
+        count = int.from_bytes(self.srwp.read(4), "little")
+        data = self.srwp.read(4 * count)
+        if len(data) != 4 * count:
+            raise IOError(f"Short manifest: expected {4 * count} bytes, got {len(data)}")
+        return [int.from_bytes(data[i:i + 4], "little") for i in range(0, len(data), 4)]
+
+    def sync_fram(self, data:bytes|bytearray, block_size:int=256):
+        """
+        Makes the FRAM match `data`, writing only the blocks that differ.
+        An unchanged device costs one SHA-256 round trip. Otherwise the block
+        manifest picks out what to write, and a final SHA-256 confirms the result
+        (falling back to a full write if a CRC collision hid a difference).
+        :param data: Data to write (padded with zeros to the FRAM size)
+        :return: Number of blocks written
+        """
+        data = bytes(self.fill_with_null_bytes_to_fit_fram(data))[:self.fram_size]
+        want = hashlib.sha256(data).digest()
+
+        if self.sha256_fram(0, self.fram_size) == want:
+            return 0
+
+        written = 0
+        for i, crc in enumerate(self.read_manifest(block_size)):
+            block = data[i * block_size:(i + 1) * block_size]
+            if zlib.crc32(block) != crc:
+                self.write_fram(i * block_size, block)
+                written += 1
+
+        if self.sha256_fram(0, self.fram_size) != want:
+            self.logger.warning("Digest mismatch after block sync, writing everything")
+            self.write_fram_all(data)
+            written = len(range(0, self.fram_size, block_size))
+
+        return written
+
+    def fetch_fram(self, data:bytes|bytearray, block_size:int=256):
+        """
+        Brings a local copy of the FRAM up to date, reading only the blocks that differ.
+        :param data: Previous copy (padded with zeros to the FRAM size)
+        :return: (updated copy as bytes, number of blocks read)
+        """
+        data = bytearray(self.fill_with_null_bytes_to_fit_fram(data)[:self.fram_size])
+
+        if self.sha256_fram(0, self.fram_size) == hashlib.sha256(data).digest():
+            return bytes(data), 0
+
+        fetched = 0
+        for i, crc in enumerate(self.read_manifest(block_size)):
+            start = i * block_size
+            end = min(start + block_size, self.fram_size)
+            if zlib.crc32(data[start:end]) != crc:
+                data[start:end] = self.read_fram_retry(start, end - start)
+                fetched += 1
+
+        return bytes(data), fetched
+
+    def read_fram_vec(self, segments:list):
+        """
+        Reads several ranges in one exchange (CMD_READV), e.g. a header and a
+        few records. Ranges past the end of the chip are zero-padded, as in read_fram().
+        Over a v2 session (open_v2()) the ranges are split to fit frames and pipelined.
+        :param segments: List of (addr, size)
+        :return: List of bytes, one per segment
+        """
+        if self.v2:
+            return self._read_fram_vec_v2(segments)
+
+        out = []
+        for first in range(0, len(segments), VEC_MAX):
+            batch = segments[first:first + VEC_MAX]
+            self.flush()
+
+            ba = bytearray()
+            ba.extend(b'\x00')    # Enter SRWP mode
+            ba.extend(bytes([CMD_READV]))
+            ba.extend(len(batch).to_bytes(4, byteorder='little'))
+            for addr, size in batch:
+                ba.extend(struct.pack("<II", addr, size))
+
+            self.srwp.write(ba)
+            self.srwp.flush()
+
+            for addr, size in batch:
+                data = self.srwp.read(size)
+                if len(data) != size:
+                    raise IOError(f"Short vectored read: expected {size} bytes at {addr}, got {len(data)}")
+                out.append(data)
+        return out
+
+    def _read_fram_vec_v2(self, segments:list):
+        # (segment, piece size) pairs, no piece bigger than a frame,
+        # packed into as few CMD_READV frames as fit
+        frame_max = self.v2[1]
+        pieces = []
+        for i, (addr, size) in enumerate(segments):
+            for o in range(0, size, frame_max):
+                pieces.append((i, addr + o, min(frame_max, size - o)))
+        reqs, groups, group, used = [], [], [], 0
+        for piece in pieces + [None]:
+            if piece is None or used + piece[2] > frame_max or len(group) == VEC_MAX:
+                if group:
+                    reqs.append((CMD_READV, struct.pack("<I", len(group)) + b"".join(struct.pack("<II", a, n) for _, a, n in group)))
+                    groups.append(group)
+                group, used = [], 0
+            if piece is not None:
+                group.append(piece)
+                used += piece[2]
+
+        out = [bytearray() for _ in segments]
+        for group, (status, payload) in zip(groups, self.transact_v2(reqs)):
+            if status not in (STATUS_OK, STATUS_RANGE):
+                raise IOError(f"SRWP v2 vectored read failed, status {status}")
+            at = 0
+            for i, _, n in group:
+                out[i].extend(payload[at:at + n])
+                at += n
+        return [bytes(b) for b in out]
+
+    def write_fram_vec(self, segments:list):
+        """
+        Writes several ranges in one exchange (CMD_WRITEV). Bytes past the end
+        of the chip are dropped, as in write_fram().
+        :param segments: List of (addr, data)
+        """
+        if self.v2:
+            # pieces no bigger than a frame, packed into as few CMD_WRITEV
+            # frames as fit
+            frame_max = self.v2[1]
+            step = frame_max - 12
+            pieces = [struct.pack("<II", addr + o, len(data[o:o + step])) + bytes(data[o:o + step])
+                for addr, data in segments for o in range(0, len(data), step)]
+            reqs, group = [], []
+            for piece in pieces + [None]:
+                if piece is None or 4 + sum(map(len, group)) + len(piece) > frame_max or len(group) == VEC_MAX:
+                    if group:
+                        reqs.append((CMD_WRITEV, struct.pack("<I", len(group)) + b"".join(group)))
+                    group = []
+                if piece is not None:
+                    group.append(piece)
+            statuses = [status for status, _ in self.transact_v2(reqs)]
+            if any(st not in (STATUS_OK, STATUS_RANGE) for st in statuses):
+                raise IOError(f"SRWP v2 vectored write failed, statuses {statuses}")
+            return
+
+        for first in range(0, len(segments), VEC_MAX):
+            batch = segments[first:first + VEC_MAX]
+            self.flush()
+
+            ba = bytearray()
+            ba.extend(b'\x00')    # Enter SRWP mode
+            ba.extend(bytes([CMD_WRITEV]))
+            ba.extend(len(batch).to_bytes(4, byteorder='little'))
+            for addr, data in batch:
+                ba.extend(struct.pack("<II", addr, len(data)))
+                ba.extend(data)
+
+            self.srwp.write(ba)
+            self.srwp.flush()
+
     def read_fram_retry(self, addr:int, size:int, max_retries:int=3):
         """
         Reads `size` bytes from address `addr` on the FRAM chip with retries.
@@ -187,6 +418,296 @@ class BlaustahlSRWP:
             except SerialException:
                 self.logger.error(f"Failed to write chunk: {offset} - {chunk}")
 
+    # SRWP v2 - framed, pipelined session
+    def open_v2(self, window:int=8):
+        """
+        Switches the device to SRWP v2 framing (CMD_HELLO).
+        :param window: Most requests to have in flight at once; the device may grant fewer
+        :return: True if the device speaks v2
+        """
+        self.flush()
+
+        ba = bytearray()
+        ba.extend(b'\x00')    # Enter SRWP mode
+        ba.extend(bytes([CMD_HELLO, 2, min(window, 255)]))
+
+        self.srwp.write(ba)
+        self.srwp.flush()
+
+        reply = self.srwp.read(6)
+        if len(reply) != 6:
+            return False    # firmware without v2: HELLO is an unknown command
+        version, window, frame_max, idle_ms = struct.unpack("<BBHH", reply)
+        if version != 2:
+            return False
+
+        self.v2 = (window, frame_max, idle_ms / 1000)
+        self.v2_seq = 0
+        self.v2_last = time.monotonic()
+        return True
+
+    def close_v2(self):
+        """
+        Ends the v2 session, back to v1.
+        """
+        if not self.v2:
+            return
+        since = time.monotonic() - self.v2_last
+        if since < self.v2[2] / 2:
+            self.transact_v2([(CMD_BYE, b'')])
+        else:
+            time.sleep(max(0, self.v2[2] * 1.5 - since))    # let it time out instead
+        self.v2 = None
+
+    def _frame(self, seq:int, op:int, payload:bytes):
+        head = struct.pack("<BBH", seq, op, len(payload))
+        return bytes([SRWP_SOF]) + head + payload + struct.pack("<I", zlib.crc32(head + payload))
+
+    def _read_frame(self):
+        """
+        Next reply frame as (seq, status, payload), or None if it was corrupt.
+        :raises TimeoutError: If nothing arrives
+        """
+        while True:
+            b = self.srwp.read(1)
+            if not b:
+                raise TimeoutError("No reply frame")
+            if b[0] == SRWP_SOF:
+                break
+        head = self.srwp.read(4)
+        if len(head) != 4:
+            raise TimeoutError("Short reply frame")
+        seq, status, size = struct.unpack("<BBH", head)
+        rest = self.srwp.read(size + 4)
+        if len(rest) != size + 4:
+            raise TimeoutError("Short reply frame")
+        payload, crc = rest[:size], int.from_bytes(rest[size:], "little")
+        if zlib.crc32(head + payload) != crc:
+            return None
+        return seq, status, payload
+
+    def transact_v2(self, requests:list, max_retries:int=3):
+        """
+        Runs (command, payload) requests in order, keeping up to the
+        negotiated window of them in flight. A corrupt frame either way is
+        recovered by resending from the first unanswered request (go-back-N).
+        :return: List of (status, payload), one per request
+        """
+        window, frame_max, idle = self.v2
+
+        # past the device's idle timeout the session has quietly ended, and
+        # near it it might end mid-burst -- wait it out, then start afresh
+        since = time.monotonic() - self.v2_last
+        if since > idle / 2:
+            time.sleep(max(0, idle * 1.5 - since))
+            if not self.open_v2(window):
+                raise IOError("SRWP v2 session could not be reopened")
+
+        seq0 = self.v2_seq
+        results = []
+        sent = 0
+        retries = 0
+
+        while len(results) < len(requests):
+            base = len(results)
+            while sent < len(requests) and sent - base < window:
+                cmd, payload = requests[sent]
+                self.srwp.write(self._frame((seq0 + sent) & 0xff, cmd, payload))
+                sent += 1
+            self.srwp.flush()
+
+            try:
+                reply = self._read_frame()
+            except TimeoutError:
+                reply = None
+            self.v2_last = time.monotonic()
+
+            if reply is not None and reply[1] not in (STATUS_BAD_FRAME, STATUS_BAD_SEQ):
+                if reply[0] == (seq0 + base) & 0xff:
+                    results.append((reply[1], reply[2]))
+                continue    # else a stale reply from before a resend
+
+            # a NAK names the seq the device wants next -- anything else
+            # means replies to requests it already ran went missing
+            if reply is not None and reply[0] != (seq0 + base) & 0xff:
+                raise IOError(f"SRWP v2 replies lost: device expects seq {reply[0]}, next unanswered is {(seq0 + base) & 0xff}")
+            retries += 1
+            if retries > max_retries:
+                raise IOError("SRWP v2 request failed after retries")
+            self.logger.warning(f"SRWP v2 frame rejected, resending from seq {(seq0 + base) & 0xff}")
+            time.sleep(SRWP_PURGE_SECONDS)
+            self.flush()
+            sent = base
+
+        self.v2_seq = (seq0 + len(requests)) & 0xff
+        return results
+
+    def read_fram_v2(self, addr:int, size:int):
+        """
+        Like read_fram(), as frame-sized reads pipelined over a v2 session.
+        """
+        step = self.v2[1]
+        reqs = [(CMD_READ, struct.pack("<II", a, min(step, addr + size - a))) for a in range(addr, addr + size, step)]
+        data = bytearray()
+        for status, payload in self.transact_v2(reqs):
+            if status not in (STATUS_OK, STATUS_RANGE):
+                raise IOError(f"SRWP v2 read failed, status {status}")
+            data.extend(payload)
+        return bytes(data)
+
+    def write_fram_v2(self, addr:int, data:bytes|bytearray):
+        """
+        Like write_fram(), as frame-sized writes pipelined over a v2 session.
+        :return: True if every byte landed on the chip (none past its end)
+        """
+        step = self.v2[1] - 8
+        reqs = [(CMD_WRITE, struct.pack("<II", addr + o, len(data[o:o + step])) + bytes(data[o:o + step])) for o in range(0, len(data), step)]
+        statuses = [status for status, _ in self.transact_v2(reqs)]
+        if any(st not in (STATUS_OK, STATUS_RANGE) for st in statuses):
+            raise IOError(f"SRWP v2 write failed, statuses {statuses}")
+        return all(st == STATUS_OK for st in statuses)
+
+    # Flash files
+    def _name(self, name:str):
+        b = name.encode()
+        if not 0 < len(b) <= 31:
+            raise ValueError(f"Flash file names are 1 to 31 bytes: {name!r}")
+        return bytes([len(b)]) + b
+
+    def _file_cmd(self, cmd:int, body:bytes, reply_len:int):
+        self.flush()
+
+        ba = bytearray()
+        ba.extend(b'\x00')    # Enter SRWP mode
+        ba.extend(bytes([cmd]))
+        ba.extend(body)
+
+        self.srwp.write(ba)
+        self.srwp.flush()
+
+        reply = self.srwp.read(reply_len)
+        if len(reply) != reply_len:
+            raise IOError(f"Short reply: expected {reply_len} bytes, got {len(reply)}")
+        return reply
+
+    def list_files(self):
+        """
+        Lists the files in the flash partition.
+        :return: List of (name, size)
+        """
+        files = []
+        while True:
+            if self.v2:
+                # one entry is at most 36 bytes, and a reply has to fit a frame
+                status, payload = self.transact_v2([(CMD_FILE_LIST, struct.pack("<II", len(files), (self.v2[1] - 8) // 36))])[0]
+                if status != STATUS_OK:
+                    raise IOError(f"SRWP v2 file list failed, status {status}")
+            else:
+                head = self._file_cmd(CMD_FILE_LIST, struct.pack("<II", len(files), 0xffffffff), 8)
+                count = int.from_bytes(head[4:8], "little")
+                payload = bytearray(head)
+                for _ in range(count):
+                    entry = self.srwp.read(5)
+                    payload.extend(entry)
+                    payload.extend(self.srwp.read(entry[4]))
+
+            total, count = struct.unpack("<II", payload[:8])
+            at = 8
+            for _ in range(count):
+                size, n = struct.unpack("<IB", payload[at:at + 5])
+                files.append((payload[at + 5:at + 5 + n].decode(errors="replace"), size))
+                at += 5 + n
+            if count == 0 or len(files) >= total:
+                return files
+
+    def stat_file(self, name:str):
+        """
+        Size of a flash file.
+        :return: Size in bytes, or None if there's no such file
+        """
+        if self.v2:
+            status, payload = self.transact_v2([(CMD_FILE_STAT, self._name(name))])[0]
+        else:
+            payload = self._file_cmd(CMD_FILE_STAT, self._name(name), 5)
+        if len(payload) != 5 or not payload[0]:
+            return None
+        return int.from_bytes(payload[1:5], "little")
+
+    def read_file(self, name:str, offset:int=0, size:int|None=None):
+        """
+        Reads `size` bytes (default: to the end) from `offset` in a flash file.
+        :return: Data as bytes, short if the file ends first
+        :raises FileNotFoundError: If there's no such file
+        """
+        length = self.stat_file(name)
+        if length is None:
+            raise FileNotFoundError(name)
+        end = length if size is None else min(length, offset + size)
+
+        if self.v2:
+            step = self.v2[1] - 4
+            reqs = [(CMD_FILE_READ, self._name(name) + struct.pack("<II", o, min(step, end - o))) for o in range(offset, end, step)]
+            data = bytearray()
+            for status, payload in self.transact_v2(reqs):
+                if status != STATUS_OK:
+                    raise IOError(f"SRWP v2 file read failed, status {status}")
+                data.extend(payload[4:])
+            return bytes(data)
+
+        data = bytearray()
+        for o in range(offset, end, FILE_CHUNK):
+            got = int.from_bytes(self._file_cmd(CMD_FILE_READ, self._name(name) + struct.pack("<II", o, min(FILE_CHUNK, end - o)), 4), "little")
+            chunk = self.srwp.read(got)
+            if len(chunk) != got:
+                raise IOError(f"Short file read: expected {got} bytes, got {len(chunk)}")
+            data.extend(chunk)
+            if got == 0:
+                break
+        return bytes(data)
+
+    def write_file(self, name:str, data:bytes|bytearray):
+        """
+        Writes a whole flash file, replacing any file of that name. The device
+        streams it to a temporary file and swaps it in at the end, so on any
+        failure the old file is left as it was.
+        :return: True if the file was written
+        """
+        if self.v2:
+            step = self.v2[1] - 4
+            reqs = [(CMD_FILE_CREATE, self._name(name))]
+            reqs += [(CMD_FILE_APPEND, struct.pack("<I", len(data[o:o + step])) + bytes(data[o:o + step])) for o in range(0, len(data), step)]
+            reqs += [(CMD_FILE_CLOSE, b'\x01')]
+            # the CLOSE always runs, and discards a stream an APPEND failed on
+            return all(status == STATUS_OK for status, _ in self.transact_v2(reqs))
+
+        if self._file_cmd(CMD_FILE_CREATE, self._name(name), 1) != b'\x01':
+            return False
+        ok = True
+        for o in range(0, len(data), FILE_CHUNK):
+            chunk = bytes(data[o:o + FILE_CHUNK])
+            ok = self._file_cmd(CMD_FILE_APPEND, struct.pack("<I", len(chunk)) + chunk, 1) == b'\x01'
+            if not ok:
+                break
+        return self._file_cmd(CMD_FILE_CLOSE, b'\x01' if ok else b'\x00', 1) == b'\x01' and ok
+
+    def rename_file(self, old:str, new:str):
+        """
+        Renames a flash file. A file already called `new` is replaced.
+        :return: True if renamed
+        """
+        if self.v2:
+            return self.transact_v2([(CMD_FILE_RENAME, self._name(old) + self._name(new))])[0][0] == STATUS_OK
+        return self._file_cmd(CMD_FILE_RENAME, self._name(old) + self._name(new), 1) == b'\x01'
+
+    def delete_file(self, name:str):
+        """
+        Deletes a flash file.
+        :return: True if deleted
+        """
+        if self.v2:
+            return self.transact_v2([(CMD_FILE_DELETE, self._name(name))])[0][0] == STATUS_OK
+        return self._file_cmd(CMD_FILE_DELETE, self._name(name), 1) == b'\x01'
+
     # Helper Functions
     def clear_fram(self):
         """
@@ -234,7 +755,8 @@ if __name__ == "__main__":
 
     parser = ArgumentParser(description="CLI tool for interacting with Blaustahl Storage Device using the SRWP protocol.")
     parser.add_argument("--device", type=str, default=None, help="Path to the serial device (e.g., /dev/ttyACM0). Defaults to auto-detection.")
-    parser.add_argument("--fram", type=int, default=None, help="Size of the FRAM Chip. Defaults to 8192 Bytes")
+    parser.add_argument("--fram", type=int, default=None, help="Size of the FRAM Chip. Defaults to the size the device reports")
+    parser.add_argument("--v2", action="store_true", help="Pipeline read/write/backup/restore over an SRWP v2 session")
 
     subparsers = parser.add_subparsers(dest="command", help="Available commands")
 
@@ -269,10 +791,36 @@ if __name__ == "__main__":
     parser_restore = subparsers.add_parser("restore", help="Restore the entire FRAM from a file")
     parser_restore.add_argument("file", type=str, help="File to read the backup from")
 
+    # Sync FRAM command
+    parser_sync = subparsers.add_parser("sync", help="Make the FRAM match a file, writing only blocks that differ")
+    parser_sync.add_argument("file", type=str, help="File to sync the FRAM to")
+
+    # Fetch FRAM command
+    parser_fetch = subparsers.add_parser("fetch", help="Update a backup file from the FRAM, reading only blocks that differ")
+    parser_fetch.add_argument("file", type=str, help="Backup file to update (created if missing)")
+
     # Verify FRAM command
     parser_verify = subparsers.add_parser("verify", help="Verify the entire FRAM against a file")
     parser_verify.add_argument("file", type=str, help="File to verify the FRAM content against")
 
+    # Flash file commands
+    subparsers.add_parser("ls", help="List the files in flash")
+
+    parser_get = subparsers.add_parser("get", help="Copy a flash file to a local file")
+    parser_get.add_argument("name", type=str, help="Flash file name")
+    parser_get.add_argument("file", type=str, nargs="?", default=None, help="Local file (default: same name)")
+
+    parser_put = subparsers.add_parser("put", help="Copy a local file to flash, replacing any of the same name")
+    parser_put.add_argument("file", type=str, help="Local file")
+    parser_put.add_argument("name", type=str, nargs="?", default=None, help="Flash file name (default: the local file's name)")
+
+    parser_mv = subparsers.add_parser("mv", help="Rename a flash file")
+    parser_mv.add_argument("old", type=str, help="Current name")
+    parser_mv.add_argument("new", type=str, help="New name (replaced if it exists)")
+
+    parser_rm = subparsers.add_parser("rm", help="Delete a flash file")
+    parser_rm.add_argument("name", type=str, help="Flash file name")
+
     # DFU Mode command
     parser_dfu = subparsers.add_parser("dfu", help="Switch the Blaustahl Storage Device to DFU mode for firmware updates")
 
@@ -280,6 +828,8 @@ if __name__ == "__main__":
 
     # Create an instance of BlaustahlSRWP
     bs = BlaustahlSRWP(device=args.device, fram_size=args.fram)
+    if args.v2 and not bs.open_v2():
+        print("Device doesn't speak SRWP v2, using v1.")
 
     # Execute based on the parsed arguments
     if args.command == "echo":
@@ -288,12 +838,15 @@ if __name__ == "__main__":
 
     elif args.command == "read":
         print(f"Reading {args.size} bytes from address {args.address}")
-        data = bs.read_fram(args.address, args.size)
+        data = bs.read_fram_v2(args.address, args.size) if bs.v2 else bs.read_fram(args.address, args.size)
         print(f"Data: {data}")
 
     elif args.command == "write":
         print(f"Writing data to address {args.address}")
-        bs.write_fram(args.address, args.data.encode('ascii'))
+        if bs.v2:
+            bs.write_fram_v2(args.address, args.data.encode('ascii'))
+        else:
+            bs.write_fram(args.address, args.data.encode('ascii'))
         print("Write complete.")
 
     elif args.command == "clear":
@@ -315,7 +868,7 @@ if __name__ == "__main__":
 
     elif args.command == "backup":
         print(f"Backing up FRAM to {args.file}...")
-        data = bs.read_fram_all()
+        data = bs.read_fram_v2(0, bs.fram_size) if bs.v2 else bs.read_fram_all()
 
         with open(args.file, 'wb') as f:
             f.write(data)
@@ -329,9 +882,35 @@ if __name__ == "__main__":
 
         data = bs.fill_with_null_bytes_to_fit_fram(data)
 
-        bs.write_fram_all(data)
+        if bs.v2:
+            bs.write_fram_v2(0, data)
+        else:
+            bs.write_fram_all(data)
         print("Restore complete.")
 
+    elif args.command == "sync":
+        print(f"Syncing FRAM to {args.file}...")
+        with open(args.file, 'rb') as f:
+            data = f.read()
+
+        blocks = bs.sync_fram(data)
+        print(f"Sync complete, {blocks} block(s) written.")
+
+    elif args.command == "fetch":
+        print(f"Fetching FRAM changes into {args.file}...")
+        try:
+            with open(args.file, 'rb') as f:
+                data = f.read()
+        except FileNotFoundError:
+            data = b''
+
+        data, blocks = bs.fetch_fram(data)
+
+        with open(args.file, 'wb') as f:
+            f.write(data)
+
+        print(f"Fetch complete, {blocks} block(s) read.")
+
     elif args.command == "verify":
         print(f"Verifying FRAM against {args.file}...")
         with open(args.file, 'rb') as f:
@@ -342,9 +921,38 @@ if __name__ == "__main__":
         else:
             print("FRAM does not match the file.")
 
+    elif args.command == "ls":
+        for name, size in bs.list_files():
+            print(f"{size:10d}  {name}")
+
+    elif args.command == "get":
+        local = args.file or args.name
+        data = bs.read_file(args.name)
+        with open(local, 'wb') as f:
+            f.write(data)
+        print(f"Copied {args.name} ({len(data)} bytes) to {local}.")
+
+    elif args.command == "put":
+        import os.path
+        name = args.name or os.path.basename(args.file)
+        with open(args.file, 'rb') as f:
+            data = f.read()
+        if bs.write_file(name, data):
+            print(f"Copied {args.file} ({len(data)} bytes) to {name}.")
+        else:
+            print(f"Writing {name} failed; any previous {name} is unchanged.")
+
+    elif args.command == "mv":
+        print("Renamed." if bs.rename_file(args.old, args.new) else f"Renaming {args.old} failed.")
+
+    elif args.command == "rm":
+        print("Deleted." if bs.delete_file(args.name) else f"Deleting {args.name} failed.")
+
     elif args.command == "dfu":
         print("Send into DFU Mode")
         bs.dfu_mode()
 
     else:
         parser.print_help()
+
+    bs.close_v2()
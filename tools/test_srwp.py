@@ -13,7 +13,7 @@ Runs the same test suite against either:
 SAFETY: this test suite writes to every corner of FRAM, including
 address 0 and the very last byte -- if run against real hardware, it
 WILL overwrite whatever is currently stored there. To make that safe,
-every run backs up the full 8KB via SRWP's own read command BEFORE
+every run backs up the whole chip via SRWP's own read command BEFORE
 touching anything, and restores it afterward in a `finally` block, so
 the restore still happens even if a test fails or raises partway
 through. The backup is also written to a local timestamped file as a
@@ -25,20 +25,58 @@ Usage:
     python3 test_srwp.py --port /dev/ttyACM0
     python3 test_srwp.py --exec ./driver          # test build, no hardware
     python3 test_srwp.py --port /dev/ttyACM0 --skip-backup   # DANGEROUS, see below
+    python3 test_srwp.py --port /dev/ttyACM0 --throughput    # KB/s, instead of the tests
+
+--throughput times whole-chip reads, writes and echoes instead of
+running the tests, and reports each in KB/s, then does the same for SRWP
+v2's pipelined reads. Its writes put back exactly
+what the chip already holds, and the usual backup/restore wraps them too.
 """
 
 import argparse
+import hashlib
 import os
 import struct
 import sys
 import time
+import zlib
 
+# set from CMD_SIZE at startup (see main()) -- the firmware detects the
+# chip's real size at boot, so this suite runs unchanged against 8KB
+# and 256KB parts
 FRAM_SIZE = 8192
 
 CMD_TEST = 0x00
 CMD_READ = 0x01
 CMD_WRITE = 0x02
 CMD_SIZE = 0x0a
+CMD_CRC32 = 0x0b
+CMD_SHA256 = 0x0c
+CMD_MANIFEST = 0x0d
+CMD_HELLO = 0x0e
+CMD_BYE = 0x0f
+CMD_READV = 0x10
+CMD_WRITEV = 0x11
+VEC_MAX = 64
+CMD_FILE_LIST = 0x20
+CMD_FILE_STAT = 0x21
+CMD_FILE_READ = 0x22
+CMD_FILE_CREATE = 0x23
+CMD_FILE_APPEND = 0x24
+CMD_FILE_CLOSE = 0x25
+CMD_FILE_RENAME = 0x26
+CMD_FILE_DELETE = 0x27
+
+# SRWP v2 frames and reply statuses (see docs/srwp.md)
+SOF = 0xa5
+ST_OK, ST_RANGE, ST_MALFORMED, ST_UNKNOWN = 0x00, 0x01, 0x02, 0x03
+ST_TOO_LONG, ST_FAILED, ST_BAD_FRAME, ST_BAD_SEQ = 0x04, 0x05, 0x06, 0x07
+ST_NOT_FOUND = 0x08
+
+
+def name_field(name):
+	b = name.encode() if isinstance(name, str) else name
+	return bytes([len(b)]) + b
 
 
 # --------------------------------------------------------------------
@@ -145,13 +183,155 @@ class SRWPClient:
 		(v,) = struct.unpack("<I", self.t.read(4))
 		return v
 
+	def crc32(self, addr, length):
+		self.t.write(bytes([0x00, CMD_CRC32]) + struct.pack("<II", addr, length))
+		(v,) = struct.unpack("<I", self.t.read(4))
+		return v
+
+	def sha256(self, addr, length):
+		self.t.write(bytes([0x00, CMD_SHA256]) + struct.pack("<II", addr, length))
+		return self.t.read(32)
+
+	def readv(self, segments):
+		self.t.write(bytes([0x00, CMD_READV]) + struct.pack("<I", len(segments))
+			+ b"".join(struct.pack("<II", a, n) for a, n in segments))
+		data = self.t.read(sum(n for _, n in segments))
+		out = []
+		for _, n in segments:
+			out.append(data[:n])
+			data = data[n:]
+		return out
+
+	def writev(self, segments):
+		self.t.write(bytes([0x00, CMD_WRITEV]) + struct.pack("<I", len(segments))
+			+ b"".join(struct.pack("<II", a, len(d)) + d for a, d in segments))
+
+	# --- flash files ---
+
+	def file_list(self, start=0, max_n=0xFFFFFFFF):
+		self.t.write(bytes([0x00, CMD_FILE_LIST]) + struct.pack("<II", start, max_n))
+		total, n = struct.unpack("<II", self.t.read(8))
+		out = []
+		for _ in range(n):
+			(size,) = struct.unpack("<I", self.t.read(4))
+			name = self.t.read(self.t.read(1)[0]).decode()
+			out.append((name, size))
+		return total, out
+
+	def file_stat(self, name):
+		self.t.write(bytes([0x00, CMD_FILE_STAT]) + name_field(name))
+		found, size = struct.unpack("<BI", self.t.read(5))
+		return size if found else None
+
+	def file_read(self, name, offset, length):
+		self.t.write(bytes([0x00, CMD_FILE_READ]) + name_field(name)
+			+ struct.pack("<II", offset, length))
+		(got,) = struct.unpack("<I", self.t.read(4))
+		return self.t.read(got)
+
+	def file_create(self, name):
+		self.t.write(bytes([0x00, CMD_FILE_CREATE]) + name_field(name))
+		return self.t.read(1) == b"\x01"
+
+	def file_append(self, data):
+		self.t.write(bytes([0x00, CMD_FILE_APPEND]) + struct.pack("<I", len(data)) + data)
+		return self.t.read(1) == b"\x01"
+
+	def file_close(self, commit=True):
+		self.t.write(bytes([0x00, CMD_FILE_CLOSE, 1 if commit else 0]))
+		return self.t.read(1) == b"\x01"
+
+	def file_rename(self, old, new):
+		self.t.write(bytes([0x00, CMD_FILE_RENAME]) + name_field(old) + name_field(new))
+		return self.t.read(1) == b"\x01"
+
+	def file_delete(self, name):
+		self.t.write(bytes([0x00, CMD_FILE_DELETE]) + name_field(name))
+		return self.t.read(1) == b"\x01"
+
+	def manifest(self, block):
+		self.t.write(bytes([0x00, CMD_MANIFEST]) + struct.pack("<I", block))
+		(count,) = struct.unpack("<I", self.t.read(4))
+		return list(struct.unpack(f"<{count}I", self.t.read(4 * count)))
+
+
+# --------------------------------------------------------------------
+# SRWP v2 client -- HELLO, then frames with up to `window` requests in
+# flight. A NAK means resend from the seq it names (go-back-N). The
+# `corrupt` set lets the tests damage chosen requests' CRCs, once each,
+# to drive that path.
+# --------------------------------------------------------------------
+
+class SRWPv2:
+
+	def __init__(self, transport):
+		self.t = transport
+		self.corrupt = set()
+
+	def hello(self, version=2, window=8):
+		self.t.write(bytes([0x00, CMD_HELLO, version, window]))
+		(self.version, self.window, self.frame_max, self.idle_ms) = \
+			struct.unpack("<BBHH", self.t.read(6))
+		self.seq = 0
+		return self.version
+
+	def frame(self, seq, op, payload, bad_crc=False):
+		head = struct.pack("<BBH", seq, op, len(payload))
+		crc = zlib.crc32(head + payload) ^ (1 if bad_crc else 0)
+		return bytes([SOF]) + head + payload + struct.pack("<I", crc)
+
+	def read_frame(self):
+		while self.t.read(1)[0] != SOF:
+			pass
+		head = self.t.read(4)
+		seq, status, size = struct.unpack("<BBH", head)
+		payload = self.t.read(size)
+		(crc,) = struct.unpack("<I", self.t.read(4))
+		assert crc == zlib.crc32(head + payload), "reply frame CRC mismatch"
+		return seq, status, payload
+
+	# [(cmd, payload), ...] -> [(status, payload), ...], pipelined
+	def transact(self, requests):
+		seq0 = self.seq
+		results = []
+		sent = 0
+		self.resends = 0
+		while len(results) < len(requests):
+			base = len(results)
+			burst = b""
+			while sent < len(requests) and sent - base < self.window:
+				cmd, payload = requests[sent]
+				bad = sent in self.corrupt
+				self.corrupt.discard(sent)
+				burst += self.frame((seq0 + sent) & 0xff, cmd, payload, bad)
+				sent += 1
+			if burst:
+				self.t.write(burst)
+			seq, status, payload = self.read_frame()
+			if status in (ST_BAD_FRAME, ST_BAD_SEQ):
+				assert seq == (seq0 + base) & 0xff, "NAK for a seq already answered"
+				self.resends += 1
+				time.sleep(0.1)		# past the device's 50ms purge
+				sent = base
+				continue
+			assert seq == (seq0 + base) & 0xff, "reply out of order"
+			results.append((status, payload))
+		self.seq = (seq0 + len(requests)) & 0xff
+		return results
+
+	def one(self, cmd, payload=b""):
+		return self.transact([(cmd, payload)])[0]
+
+	def bye(self):
+		return self.one(CMD_BYE)
+
 
 # --------------------------------------------------------------------
 # Backup / restore -- see the SAFETY note in the module docstring.
 # --------------------------------------------------------------------
 
 def backup_fram(client):
-	print("Backing up all 8192 bytes of FRAM before testing...")
+	print(f"Backing up all {FRAM_SIZE} bytes of FRAM before testing...")
 	data = client.read(0, FRAM_SIZE)
 	assert len(data) == FRAM_SIZE
 	fname = f"srwp_fram_backup_{int(time.time())}.bin"
@@ -204,7 +384,10 @@ def run_tests(client):
 
 	# --- CMD_SIZE ---
 	sz = client.size()
-	check("CMD_SIZE reports 8192 (full physical chip)", sz == FRAM_SIZE)
+	check(f"CMD_SIZE consistently reports {FRAM_SIZE} (full physical chip)",
+		sz == FRAM_SIZE)
+	check("CMD_SIZE is a power of two, at least 8KB",
+		sz >= 8192 and (sz & (sz - 1)) == 0)
 
 	# --- CMD_WRITE / CMD_READ round trips ---
 	payload = bytes(range(256)) * 2
@@ -254,12 +437,338 @@ def run_tests(client):
 	readback = client.read(0, len(big))
 	check("large transfer (4000 bytes) is byte-exact", readback == big)
 
+	# --- digests: same bytes CMD_READ would return, zero padding included ---
+	image = client.read(0, FRAM_SIZE)
+	check("CMD_CRC32 of the whole chip matches zlib.crc32",
+		client.crc32(0, FRAM_SIZE) == zlib.crc32(image))
+	check("CMD_CRC32 of a short unaligned range",
+		client.crc32(1234, 77) == zlib.crc32(image[1234:1234 + 77]))
+	check("CMD_CRC32 of an empty range", client.crc32(10, 0) == 0)
+	check("CMD_CRC32 counts the out-of-bounds part as zeros",
+		client.crc32(FRAM_SIZE - 4, 10) == zlib.crc32(client.read(FRAM_SIZE - 4, 10)))
+	check("CMD_SHA256 of the whole chip matches hashlib",
+		client.sha256(0, FRAM_SIZE) == hashlib.sha256(image).digest())
+	check("CMD_SHA256 of a range spanning several chunks",
+		client.sha256(100, 1000) == hashlib.sha256(image[100:1100]).digest())
+
+	m = client.manifest(256)
+	check("CMD_MANIFEST: one CRC per 256-byte block, matching zlib",
+		m == [zlib.crc32(image[i:i + 256]) for i in range(0, FRAM_SIZE, 256)])
+	m = client.manifest(3000)
+	check("CMD_MANIFEST with a block that doesn't divide the chip",
+		m == [zlib.crc32(image[i:i + 3000]) for i in range(0, FRAM_SIZE, 3000)])
+	check("CMD_MANIFEST refuses a too-small block with an empty list",
+		client.manifest(16) == [] and client.manifest(0) == [])
+
+	before = client.manifest(256)
+	client.write(4101, bytes([image[4101] ^ 0xff]))
+	after = client.manifest(256)
+	diff = [i for i in range(len(after)) if after[i] != before[i]]
+	check("one changed byte shows up as exactly one changed block",
+		diff == [4101 // 256])
+
 	# --- malformed length must not hang or crash the session ---
 	client.t.write(bytes([0x00, CMD_READ]) + struct.pack("<II", 0, 0xFFFFFFFF))
 	out = client.test(b"ping")
 	check("absurd length (0xFFFFFFFF) aborted safely, session still works",
 		out == b"ping")
 
+	# --- vectored reads and writes ---
+	image = client.read(0, FRAM_SIZE)
+	segs = [(0, 16), (5000, 3), (FRAM_SIZE - 2, 6), (100, 1000), (7, 0), (0, 4)]
+	out = client.readv(segs)
+	check("CMD_READV returns each segment, in order, as CMD_READ would",
+		out == [client.read(a, n) for a, n in segs])
+	check("CMD_READV zero-pads a segment past the end",
+		out[2] == image[FRAM_SIZE - 2:] + b"\0" * 4)
+	check("CMD_READV with no segments", client.readv([]) == [])
+
+	client.writev([(300, b"first"), (6000, b"second"), (FRAM_SIZE - 1, b"XY"), (10, b"")])
+	check("CMD_WRITEV writes every segment, dropping bytes past the end",
+		client.readv([(300, 5), (6000, 6), (FRAM_SIZE - 1, 1)])
+			== [b"first", b"second", b"X"])
+
+	client.t.write(bytes([0x00, CMD_READV]) + struct.pack("<III", 2, 0, 4)
+		+ struct.pack("<II", 0, 0xFFFFFFFF))
+	check("CMD_READV with one absurd segment sends nothing at all",
+		client.test(b"ping") == b"ping")
+	client.t.write(bytes([0x00, CMD_READV]) + struct.pack("<I", VEC_MAX + 1))
+	check("CMD_READV with too many segments aborted, session still works",
+		client.test(b"pong") == b"pong")
+
+	run_file_tests(client)
+
+	run_v2_tests(client)
+
+
+# Flash file tests. They only ever touch names that didn't exist when
+# they started (checked with CMD_FILE_STAT), and delete them again, so
+# they're as safe against real hardware as the FRAM tests are.
+def run_file_tests(client):
+
+	tag = f"srwp{os.getpid() % 100000}"
+	a, b = f"{tag}a.bin", f"{tag}b.bin"
+	if client.file_stat(a) is not None or client.file_stat(b) is not None:
+		print(f"  (skipping flash file tests: {a} or {b} already exists)")
+		return
+
+	try:
+		check("CMD_FILE_STAT of a missing file: not found", client.file_stat(a) is None)
+
+		data = bytes((i * 31 + 7) % 256 for i in range(10000))
+		ok = client.file_create(a)
+		for o in range(0, len(data), 3000):
+			ok = client.file_append(data[o:o + 3000]) and ok
+		check("CMD_FILE_CREATE/APPEND/CLOSE writes a file",
+			client.file_close() and ok and client.file_stat(a) == len(data))
+
+		total, listing = client.file_list()
+		check("CMD_FILE_LIST includes it, with its size",
+			(a, len(data)) in listing and total == len(listing))
+		page = client.file_list(start=total - 1, max_n=5)
+		check("CMD_FILE_LIST pages: one entry from the last position",
+			page[0] == total and page[1] == listing[-1:])
+		check("CMD_FILE_LIST past the end: no entries",
+			client.file_list(start=total + 3)[1] == [])
+
+		check("CMD_FILE_READ of the whole file (several flash blocks)",
+			client.file_read(a, 0, len(data)) == data)
+		check("CMD_FILE_READ of a range",
+			client.file_read(a, 4000, 300) == data[4000:4300])
+		check("CMD_FILE_READ clipped at the end of the file",
+			client.file_read(a, len(data) - 10, 100) == data[-10:])
+		check("CMD_FILE_READ past the end, and of a missing file: nothing",
+			client.file_read(a, len(data) + 1, 10) == b""
+			and client.file_read(b, 0, 10) == b"")
+
+		ok = client.file_create(a) and client.file_append(b"replacement")
+		check("CMD_FILE_CLOSE without commit leaves the old file alone",
+			ok and client.file_close(commit=False) and client.file_stat(a) == len(data))
+		check("CMD_FILE_APPEND and CLOSE with no stream open fail",
+			not client.file_append(b"x") and not client.file_close())
+
+		check("a small file round trips too",
+			client.file_create(b) and client.file_append(b"tiny") and client.file_close()
+			and client.file_read(b, 0, 100) == b"tiny")
+
+		check("CMD_FILE_RENAME replaces the target, like the browser",
+			client.file_rename(a, b) and client.file_stat(a) is None
+			and client.file_read(b, 0, len(data)) == data)
+		check("CMD_FILE_RENAME of a missing file fails",
+			not client.file_rename(a, f"{tag}c.bin"))
+
+		check("rejected names (too long, '/', empty) fail without desyncing",
+			client.file_stat("x" * 40) is None and not client.file_create("d/e")
+			and not client.file_delete("") and client.test(b"ping") == b"ping")
+
+		check("CMD_FILE_DELETE removes it", client.file_delete(b) and client.file_stat(b) is None)
+		check("CMD_FILE_DELETE of a missing file fails", not client.file_delete(b))
+
+	finally:
+		client.file_close(commit=False)
+		for name in (a, b):
+			if client.file_stat(name) is not None:
+				client.file_delete(name)
+
+
+def run_v2_tests(client):
+
+	v2 = SRWPv2(client.t)
+
+	check("HELLO asking for v1 stays on v1",
+		v2.hello(version=1) == 1 and client.size() == FRAM_SIZE)
+
+	check("HELLO negotiates v2", v2.hello(window=64) == 2)
+	check("window capped by the device, frames at least 64 bytes",
+		1 <= v2.window < 64 and v2.frame_max >= 64)
+
+	# --- pipelined reads and writes ---
+	step = v2.frame_max - 8
+	image = bytes((i * 13 + 5) % 256 for i in range(3 * step + 100))
+	out = v2.transact([(CMD_WRITE, struct.pack("<II", 200 + o, len(image[o:o + step]))
+		+ image[o:o + step]) for o in range(0, len(image), step)])
+	check("pipelined writes all succeed", all(st == ST_OK for st, _ in out))
+
+	reqs = [(CMD_READ, struct.pack("<II", 200 + i * 64, 64)) for i in range(20)]
+	out = v2.transact(reqs)
+	check(f"20 pipelined 64-byte reads, {v2.window} in flight, come back in order",
+		b"".join(p for _, p in out) == image[:20 * 64]
+		and all(st == ST_OK for st, _ in out))
+
+	out = v2.transact([(CMD_SIZE, b""), (CMD_CRC32, struct.pack("<II", 200, 500)),
+		(CMD_TEST, struct.pack("<I", 3) + b"abc")])
+	check("mixed pipelined commands reuse the v1 bodies",
+		out[0] == (ST_OK, struct.pack("<I", FRAM_SIZE))
+		and out[1] == (ST_OK, struct.pack("<I", zlib.crc32(image[:500])))
+		and out[2] == (ST_OK, b"abc"))
+
+	# --- status codes ---
+	st, p = v2.one(CMD_READ, struct.pack("<II", FRAM_SIZE - 2, 6))
+	check("read past the end: RANGE, zero-padded data still sent",
+		st == ST_RANGE and len(p) == 6 and p[2:] == b"\0" * 4)
+	st, _ = v2.one(CMD_WRITE, struct.pack("<II", FRAM_SIZE - 1, 3) + b"xyz")
+	check("write past the end: RANGE", st == ST_RANGE
+		and v2.one(CMD_READ, struct.pack("<II", FRAM_SIZE - 1, 1))[1] == b"x")
+	check("unknown command: UNKNOWN", v2.one(0x77) == (ST_UNKNOWN, b""))
+	before = v2.one(CMD_READ, struct.pack("<II", 0, 8))[1]
+	st, _ = v2.one(CMD_WRITE, struct.pack("<II", 0, 4) + b"12345678")
+	check("write with a body longer than its length: MALFORMED, nothing written",
+		st == ST_MALFORMED
+		and v2.one(CMD_READ, struct.pack("<II", 0, 8))[1] == before)
+	check("read with a truncated body: MALFORMED",
+		v2.one(CMD_READ, b"\0" * 7) == (ST_MALFORMED, b""))
+	check("read too big for one frame: TOO_LONG, no partial data",
+		v2.one(CMD_READ, struct.pack("<II", 0, v2.frame_max + 1)) == (ST_TOO_LONG, b""))
+
+	# --- vectored, framed ---
+	out = v2.one(CMD_READV, struct.pack("<I", 3) + struct.pack("<IIIIII",
+		200, 10, 1000, 20, FRAM_SIZE - 1, 2))
+	check("v2 CMD_READV: segments back to back, RANGE for the one past the end",
+		out[0] == ST_RANGE and out[1][:10] == image[:10]
+		and out[1][10:30] == image[800:820] and out[1][31:] == b"\0")
+	body = struct.pack("<I", 2) + struct.pack("<II", 40, 3) + b"abc" \
+		+ struct.pack("<II", 60, 4) + b"de"
+	before = v2.one(CMD_READ, struct.pack("<II", 40, 3))[1]
+	check("v2 CMD_WRITEV with a short segment: MALFORMED, nothing written",
+		v2.one(CMD_WRITEV, body) == (ST_MALFORMED, b"")
+		and v2.one(CMD_READ, struct.pack("<II", 40, 3))[1] == before)
+	body = struct.pack("<I", 2) + struct.pack("<II", 40, 3) + b"abc" \
+		+ struct.pack("<II", 60, 2) + b"de"
+	check("v2 CMD_WRITEV writes every segment",
+		v2.one(CMD_WRITEV, body) == (ST_OK, b"")
+		and v2.one(CMD_READV, struct.pack("<IIIII", 2, 40, 3, 60, 2)) == (ST_OK, b"abcde"))
+
+	# --- flash files, framed ---
+	tag = f"srwp{os.getpid() % 100000}v"
+	if v2.one(CMD_FILE_STAT, name_field(tag))[0] == ST_NOT_FOUND:
+		data = bytes((i * 7) % 251 for i in range(5000))
+		step = v2.frame_max - 4
+		out = v2.transact([(CMD_FILE_CREATE, name_field(tag))]
+			+ [(CMD_FILE_APPEND, struct.pack("<I", len(data[o:o + step])) + data[o:o + step])
+				for o in range(0, len(data), step)]
+			+ [(CMD_FILE_CLOSE, b"\x01")])
+		check("v2: a file written with pipelined APPENDs",
+			all(r == (ST_OK, b"\x01") for r in out))
+		out = v2.transact([(CMD_FILE_READ, name_field(tag) + struct.pack("<II", o, step))
+			for o in range(0, len(data), step)])
+		check("v2: and read back with pipelined ranged reads",
+			b"".join(p[4:] for _, p in out) == data)
+		check("v2: CMD_FILE_DELETE, then the file is NOT_FOUND",
+			v2.one(CMD_FILE_DELETE, name_field(tag)) == (ST_OK, b"\x01")
+			and v2.one(CMD_FILE_STAT, name_field(tag)) == (ST_NOT_FOUND, b""))
+		check("v2: a name field running past the payload is MALFORMED",
+			v2.one(CMD_FILE_STAT, bytes([9]) + b"abc") == (ST_MALFORMED, b""))
+
+	# --- integrity and ordering ---
+	v2.t.write(v2.frame(v2.seq, CMD_SIZE, b"", bad_crc=True))
+	seq, st, _ = v2.read_frame()
+	check("corrupt frame: BAD_FRAME NAK naming the expected seq",
+		st == ST_BAD_FRAME and seq == v2.seq)
+	time.sleep(0.1)
+	check("session carries on after a corrupt frame",
+		v2.one(CMD_SIZE) == (ST_OK, struct.pack("<I", FRAM_SIZE)))
+
+	v2.t.write(v2.frame((v2.seq + 5) & 0xff, CMD_SIZE, b"")
+		+ v2.frame((v2.seq + 6) & 0xff, CMD_SIZE, b""))
+	seq, st, _ = v2.read_frame()
+	check("out-of-order frames: one BAD_SEQ NAK for the gap, not one each",
+		st == ST_BAD_SEQ and seq == v2.seq
+		and v2.one(CMD_TEST, struct.pack("<I", 2) + b"ok") == (ST_OK, b"ok"))
+
+	v2.corrupt = {3}
+	out = v2.transact(reqs)
+	check("corrupt frame mid-burst: resent from there, all replies right",
+		v2.resends == 1 and b"".join(p for _, p in out) == image[:20 * 64])
+
+	# --- back to v1 ---
+	# a stream still open when the session ends has nobody left to close
+	# it, and mustn't keep XMODEM and te locked out
+	left_open = (v2.one(CMD_FILE_STAT, name_field(tag))[0] == ST_NOT_FOUND
+		and v2.one(CMD_FILE_CREATE, name_field(tag)) == (ST_OK, b"\x01"))
+	check("BYE acknowledged", v2.bye() == (ST_OK, b""))
+	check("v1 commands work again after BYE", client.size() == FRAM_SIZE)
+	if left_open:
+		check("a file stream left open is abandoned when the session ends",
+			not client.file_close() and client.file_stat(tag) is None)
+
+	v2.hello()
+	time.sleep(v2.idle_ms / 1000 + 0.2)
+	check("an idle v2 session times out back to v1", client.size() == FRAM_SIZE)
+
+
+# --------------------------------------------------------------------
+# Throughput -- whole-chip transfers, timed. CMD_WRITE has no reply, so
+# each write pass ends with a 1-byte read: SRWP handles one command at
+# a time, in order, so that read's reply can't arrive before the write
+# has landed.
+# --------------------------------------------------------------------
+
+def run_throughput(client, passes=5):
+
+	def rate(nbytes, seconds):
+		return nbytes / 1024 / seconds if seconds > 0 else float("inf")
+
+	print(f"{passes} passes of {FRAM_SIZE} bytes each:")
+
+	t0 = time.perf_counter()
+	for _ in range(passes):
+		image = client.read(0, FRAM_SIZE)
+	t = time.perf_counter() - t0
+	print(f"  CMD_READ   {rate(passes * FRAM_SIZE, t):8.1f} KB/s")
+
+	t0 = time.perf_counter()
+	for _ in range(passes):
+		client.write(0, image)
+		client.read(0, 1)
+	t = time.perf_counter() - t0
+	print(f"  CMD_WRITE  {rate(passes * FRAM_SIZE, t):8.1f} KB/s")
+
+	t0 = time.perf_counter()
+	for _ in range(passes):
+		client.test(image)
+	t = time.perf_counter() - t0
+	print(f"  CMD_TEST   {rate(passes * FRAM_SIZE, t):8.1f} KB/s each way")
+
+	# v2: frame-sized reads with a window of them in flight, and many
+	# small reads, where v1's strict ping-pong costs the most
+	v2 = SRWPv2(client.t)
+	if v2.hello() == 2:
+		reqs = [(CMD_READ, struct.pack("<II", a, min(v2.frame_max, FRAM_SIZE - a)))
+			for a in range(0, FRAM_SIZE, v2.frame_max)]
+		t0 = time.perf_counter()
+		for _ in range(passes):
+			v2.transact(reqs)
+		t = time.perf_counter() - t0
+		print(f"  v2 READ    {rate(passes * FRAM_SIZE, t):8.1f} KB/s "
+			f"({v2.frame_max}-byte frames, window {v2.window})")
+
+		small = [(CMD_READ, struct.pack("<II", i * 16, 16)) for i in range(256)]
+		t0 = time.perf_counter()
+		v2.transact(small)
+		t2 = time.perf_counter() - t0
+		v2.bye()
+		t0 = time.perf_counter()
+		for i in range(256):
+			client.read(i * 16, 16)
+		t1 = time.perf_counter() - t0
+		print(f"  256 x 16-byte reads: v1 {t1 * 1000:.1f} ms, "
+			f"v2 pipelined {t2 * 1000:.1f} ms")
+
+	# scattered small reads, one command each vs one vectored command
+	segs = [((i * 379) % (FRAM_SIZE - 16), 16) for i in range(VEC_MAX)]
+	t0 = time.perf_counter()
+	for a, n in segs:
+		client.read(a, n)
+	t1 = time.perf_counter() - t0
+	t0 = time.perf_counter()
+	client.readv(segs)
+	t2 = time.perf_counter() - t0
+	print(f"  {VEC_MAX} scattered 16-byte reads: CMD_READ each {t1 * 1000:.1f} ms, "
+		f"one CMD_READV {t2 * 1000:.1f} ms")
+
+	check("chip unchanged by the throughput passes",
+		client.read(0, FRAM_SIZE) == image)
+
 
 def main():
 
@@ -269,6 +778,9 @@ def main():
 	ap.add_argument("--baud", type=int, default=115200)
 	ap.add_argument("--exec", dest="exec_path",
 		help="path to a standalone srwp.c test build, for testing without hardware")
+	ap.add_argument("--throughput", action="store_true",
+		help="report read/write/echo throughput in KB/s instead of "
+			"running the test suite")
 	ap.add_argument("--skip-backup", action="store_true",
 		help="DANGEROUS: skip the FRAM backup/restore. Only use this "
 			"against a device you don't mind wiping, e.g. a fresh unit "
@@ -287,6 +799,10 @@ def main():
 
 	client = SRWPClient(transport)
 
+	global FRAM_SIZE
+	FRAM_SIZE = client.size()
+	print(f"Device reports {FRAM_SIZE} bytes of FRAM.")
+
 	backup_data = None
 	if not args.skip_backup:
 		backup_data, backup_fname = backup_fram(client)
@@ -296,11 +812,17 @@ def main():
 		time.sleep(3)
 
 	print()
-	print("Running SRWP test suite...")
+	if args.throughput:
+		print("Measuring SRWP throughput...")
+	else:
+		print("Running SRWP test suite...")
 	print()
 
 	try:
-		run_tests(client)
+		if args.throughput:
+			run_throughput(client)
+		else:
+			run_tests(client)
 	finally:
 		if backup_data is not None:
 			print()